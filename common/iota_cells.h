@@ -0,0 +1,122 @@
+#pragma once
+
+#include "vtkCellArray.h"
+#include "vtkIdTypeArray.h"
+#include "vtkSMPTools.h"
+#include "vtkSmartPointer.h"
+#include "vtkType.h"
+#include "vtkVersionMacros.h"
+
+#if VTK_MAJOR_VERSION >= 9
+#include "vtkTypeInt32Array.h"
+#include "vtkTypeInt64Array.h"
+#endif
+
+namespace iota_cells_detail
+{
+    /// Array type that cell arrays store without copying: with VTK 9 and later, the typed array
+    /// of the cell array storage, and the legacy vtkIdTypeArray otherwise
+#if VTK_MAJOR_VERSION >= 9
+#ifdef VTK_USE_64BIT_IDS
+    using index_array_t = vtkCellArray::ArrayType64;
+#else
+    using index_array_t = vtkCellArray::ArrayType32;
+#endif
+#else
+    using index_array_t = vtkIdTypeArray;
+#endif
+
+    /// Kind of index array
+    enum class array_kind
+    {
+        iota,           ///< 0, 1, ..., size - 1
+        legacy_verts,   ///< 1, 0, 1, 1, ..., 1, n - 1, with size = 2n
+        legacy_polyline ///< n - 1, 0, 1, ..., n - 2, with size = n
+    };
+
+    /// Create an index array of the given kind and size, filled in parallel
+    inline vtkSmartPointer<index_array_t> create_array(const array_kind kind, const vtkIdType size)
+    {
+        auto array = vtkSmartPointer<index_array_t>::New();
+        array->SetNumberOfComponents(1);
+        array->SetNumberOfValues(size);
+
+        auto* values = array->GetPointer(0);
+
+        auto fill = [values, kind, size](const vtkIdType begin, const vtkIdType end)
+        {
+            for (vtkIdType index = begin; index < end; ++index)
+            {
+                switch (kind)
+                {
+                case array_kind::iota:
+                    values[index] = index;
+                    break;
+                case array_kind::legacy_verts:
+                    values[index] = (index % 2 == 0) ? 1 : (index / 2);
+                    break;
+                case array_kind::legacy_polyline:
+                    values[index] = (index == 0) ? (size - 1) : (index - 1);
+                    break;
+                }
+            }
+        };
+
+        vtkSMPTools::For(0, size, fill);
+
+        return array;
+    }
+}
+
+/**
+ * Get a new array containing the values 0, 1, ..., size - 1, filled in parallel.
+ *
+ * The array has the type that cell arrays store without copying.
+ */
+inline vtkSmartPointer<iota_cells_detail::index_array_t> iota_array(const vtkIdType size)
+{
+    return iota_cells_detail::create_array(iota_cells_detail::array_kind::iota, size);
+}
+
+/**
+ * Create one vertex cell per point, with the point indices in order.
+ *
+ * The offsets and connectivity are filled in parallel and handed to the cell array without
+ * copying, instead of inserting the cells one by one. They are owned by the returned cells.
+ */
+inline vtkSmartPointer<vtkCellArray> vertex_cells(const vtkIdType num_points)
+{
+    auto cells = vtkSmartPointer<vtkCellArray>::New();
+
+#if VTK_MAJOR_VERSION >= 9
+    cells->SetData(iota_array(num_points + 1).GetPointer(), iota_array(num_points).GetPointer());
+#else
+    cells->SetCells(num_points, iota_cells_detail::create_array(iota_cells_detail::array_kind::legacy_verts, 2 * num_points));
+#endif
+
+    return cells;
+}
+
+/**
+ * Create a single polyline cell, connecting all points in order.
+ *
+ * The connectivity is filled in parallel and handed to the cell array without copying.
+ */
+inline vtkSmartPointer<vtkCellArray> polyline_cell(const vtkIdType num_points)
+{
+    auto cells = vtkSmartPointer<vtkCellArray>::New();
+
+#if VTK_MAJOR_VERSION >= 9
+    auto offsets = vtkSmartPointer<iota_cells_detail::index_array_t>::New();
+    offsets->SetNumberOfComponents(1);
+    offsets->SetNumberOfValues(2);
+    offsets->SetValue(0, 0);
+    offsets->SetValue(1, num_points);
+
+    cells->SetData(offsets.GetPointer(), iota_array(num_points).GetPointer());
+#else
+    cells->SetCells(1, iota_cells_detail::create_array(iota_cells_detail::array_kind::legacy_polyline, num_points + 1));
+#endif
+
+    return cells;
+}
@@ -0,0 +1,230 @@
+#pragma once
+
+#include "vtkCellArray.h"
+#include "vtkIdTypeArray.h"
+#include "vtkSMPTools.h"
+#include "vtkSmartPointer.h"
+#include "vtkType.h"
+#include "vtkVersionMacros.h"
+
+#include "common/prefix_sum.h"
+
+#include <algorithm>
+#include <vector>
+
+/**
+ * Read-only view of the lines stored in a cell array, in compressed sparse row (CSR) layout.
+ *
+ * With VTK 9 and later, the offsets and connectivity arrays of the cell array are used
+ * directly if they store vtkIdType values, and copied otherwise. With older versions,
+ * the point indices are read in place from the legacy layout, where each line is stored
+ * as its number of points followed by the point indices; only the position of each line
+ * is stored separately.
+ */
+class line_view
+{
+public:
+    explicit line_view(vtkCellArray* lines)
+    {
+        this->num_lines = lines->GetNumberOfCells();
+
+#if VTK_MAJOR_VERSION >= 9
+        this->legacy = false;
+
+        if (lines->IsStorageShareable())
+        {
+            this->offsets = static_cast<const vtkIdType*>(lines->GetOffsetsArray()->GetVoidPointer(0));
+            this->connectivity = static_cast<const vtkIdType*>(lines->GetConnectivityArray()->GetVoidPointer(0));
+        }
+        else
+        {
+            if (lines->IsStorage64Bit())
+            {
+                copy(lines->GetOffsetsArray64()->GetPointer(0), this->num_lines + 1, this->offset_storage);
+                copy(lines->GetConnectivityArray64()->GetPointer(0), lines->GetNumberOfConnectivityIds(), this->connectivity_storage);
+            }
+            else
+            {
+                copy(lines->GetOffsetsArray32()->GetPointer(0), this->num_lines + 1, this->offset_storage);
+                copy(lines->GetConnectivityArray32()->GetPointer(0), lines->GetNumberOfConnectivityIds(), this->connectivity_storage);
+            }
+
+            this->offsets = this->offset_storage.data();
+            this->connectivity = this->connectivity_storage.data();
+        }
+#else
+        this->legacy = true;
+
+        auto* data = lines->GetData();
+        const auto* values = data->GetPointer(0);
+
+        this->offset_storage.reserve(this->num_lines + 1);
+
+        for (vtkIdType index = 0; index < data->GetNumberOfValues(); index += values[index] + 1)
+        {
+            this->offset_storage.push_back(index + 1);
+        }
+
+        this->offset_storage.push_back(data->GetNumberOfValues() + 1);
+
+        this->offsets = this->offset_storage.data();
+        this->connectivity = values;
+#endif
+    }
+
+    /// Number of lines
+    vtkIdType size() const
+    {
+        return this->num_lines;
+    }
+
+    /// Number of points of a line
+    vtkIdType size(const vtkIdType line) const
+    {
+        return this->legacy ? this->connectivity[this->offsets[line] - 1] : (this->offsets[line + 1] - this->offsets[line]);
+    }
+
+    /// Total number of point indices of all lines
+    vtkIdType num_point_indices() const
+    {
+        return this->legacy ? (this->offsets[this->num_lines] - 1 - this->num_lines) : this->offsets[this->num_lines];
+    }
+
+    /// Position of the point indices of a line in the underlying storage, e.g., for indexing data per point index
+    vtkIdType offset(const vtkIdType line) const
+    {
+        return this->offsets[line];
+    }
+
+    /// Size of the underlying storage
+    vtkIdType storage_size() const
+    {
+        return this->legacy ? (this->offsets[this->num_lines] - 1) : this->offsets[this->num_lines];
+    }
+
+    /// Point indices of a line
+    const vtkIdType* begin(const vtkIdType line) const
+    {
+        return this->connectivity + this->offsets[line];
+    }
+
+    const vtkIdType* end(const vtkIdType line) const
+    {
+        return begin(line) + size(line);
+    }
+
+private:
+    template <typename value_t>
+    static void copy(const value_t* values, const vtkIdType num_values, std::vector<vtkIdType>& storage)
+    {
+        storage.assign(values, values + num_values);
+    }
+
+    vtkIdType num_lines;
+    bool legacy;
+
+    const vtkIdType* offsets;
+    const vtkIdType* connectivity;
+
+    std::vector<vtkIdType> offset_storage;
+    std::vector<vtkIdType> connectivity_storage;
+};
+
+/**
+ * Builder for a cell array of lines in compressed sparse row (CSR) layout.
+ *
+ * First, the number of points of all lines is set, after which allocate() computes
+ * the offsets. Then, the point indices of each line can be written independently,
+ * e.g., in parallel. Finally, build() creates the cell array, sharing the offsets
+ * and connectivity arrays with VTK 9 and later, or converting them to the legacy
+ * layout for older versions.
+ */
+class line_builder
+{
+public:
+    explicit line_builder(const vtkIdType num_lines) : num_lines(num_lines)
+    {
+        this->offsets = vtkSmartPointer<vtkIdTypeArray>::New();
+        this->offsets->SetNumberOfComponents(1);
+        this->offsets->SetNumberOfValues(num_lines + 1);
+        this->offsets->FillComponent(0, 0.0);
+
+        this->connectivity = vtkSmartPointer<vtkIdTypeArray>::New();
+        this->connectivity->SetNumberOfComponents(1);
+    }
+
+    /// Number of lines
+    vtkIdType size() const
+    {
+        return this->num_lines;
+    }
+
+    /// Set the number of points of a line, before allocation
+    void set_size(const vtkIdType line, const vtkIdType size)
+    {
+        this->offsets->SetValue(line + 1, size);
+    }
+
+    /// Number of points of a line, after allocation
+    vtkIdType size(const vtkIdType line) const
+    {
+        return this->offsets->GetValue(line + 1) - this->offsets->GetValue(line);
+    }
+
+    /// Compute offsets from the number of points per line, and allocate the connectivity
+    void allocate()
+    {
+        auto* offset_values = this->offsets->GetPointer(0);
+        prefix_sum(offset_values, this->num_lines + 1);
+
+        this->connectivity->SetNumberOfValues(offset_values[this->num_lines]);
+    }
+
+    /// Point indices of a line, after allocation
+    vtkIdType* begin(const vtkIdType line)
+    {
+        return this->connectivity->GetPointer(this->offsets->GetValue(line));
+    }
+
+    /// Create cell array
+    vtkSmartPointer<vtkCellArray> build()
+    {
+        auto cells = vtkSmartPointer<vtkCellArray>::New();
+
+#if VTK_MAJOR_VERSION >= 9
+        cells->SetData(this->offsets, this->connectivity);
+#else
+        const auto* offset_values = this->offsets->GetPointer(0);
+        const auto* connectivity_values = this->connectivity->GetPointer(0);
+
+        auto cell_indices = vtkSmartPointer<vtkIdTypeArray>::New();
+        cell_indices->SetNumberOfComponents(1);
+        cell_indices->SetNumberOfValues(this->num_lines + offset_values[this->num_lines]);
+
+        auto* cell_index_values = cell_indices->GetPointer(0);
+
+        auto convert = [&](const vtkIdType begin, const vtkIdType end)
+        {
+            for (vtkIdType line = begin; line < end; ++line)
+            {
+                auto* cell = cell_index_values + offset_values[line] + line;
+
+                *cell = offset_values[line + 1] - offset_values[line];
+                std::copy(connectivity_values + offset_values[line], connectivity_values + offset_values[line + 1], cell + 1);
+            }
+        };
+
+        vtkSMPTools::For(0, this->num_lines, convert);
+
+        cells->SetCells(this->num_lines, cell_indices);
+#endif
+
+        return cells;
+    }
+
+private:
+    vtkIdType num_lines;
+
+    vtkSmartPointer<vtkIdTypeArray> offsets;
+    vtkSmartPointer<vtkIdTypeArray> connectivity;
+};
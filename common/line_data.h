@@ -0,0 +1,40 @@
+#pragma once
+
+#include "vtkCellData.h"
+#include "vtkIdTypeArray.h"
+#include "vtkPolyData.h"
+#include "vtkSmartPointer.h"
+
+/**
+ * Copy the cell data of the input lines to the output lines, and add an array
+ * "Source cell id" that maps each output line to the cell it originated from.
+ *
+ * As lines are stored after vertices in poly data, the source cell ids are the
+ * indices of the source lines, offset by the number of input vertices.
+ *
+ * @param input Input poly data
+ * @param output Output poly data, containing only lines
+ * @param source_lines Index of the source line for each output line, i.e., the index within the input lines
+ */
+inline void copy_line_data(vtkPolyData* input, vtkPolyData* output, const vtkIdType* source_lines)
+{
+    const auto num_lines = output->GetLines()->GetNumberOfCells();
+    const auto line_offset = input->GetNumberOfVerts();
+
+    auto source_cell_ids = vtkSmartPointer<vtkIdTypeArray>::New();
+    source_cell_ids->SetNumberOfComponents(1);
+    source_cell_ids->SetNumberOfTuples(num_lines);
+    source_cell_ids->SetName("Source cell id");
+
+    output->GetCellData()->CopyAllocate(input->GetCellData(), num_lines);
+
+    for (vtkIdType line_index = 0; line_index < num_lines; ++line_index)
+    {
+        const auto source_cell_id = line_offset + source_lines[line_index];
+
+        source_cell_ids->SetValue(line_index, source_cell_id);
+        output->GetCellData()->CopyData(input->GetCellData(), source_cell_id, line_index);
+    }
+
+    output->GetCellData()->AddArray(source_cell_ids);
+}
@@ -0,0 +1,70 @@
+#pragma once
+
+#include "vtkSMPTools.h"
+#include "vtkType.h"
+
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+/**
+ * Parallel inclusive prefix sum in place, such that values[i] becomes the sum of values[0] to values[i].
+ *
+ * The values are split into chunks, whose sums are computed in parallel. A serial scan over
+ * the few chunk sums then yields the offset of each chunk, with which all chunks are scanned
+ * in parallel. Small inputs are scanned serially.
+ *
+ * @param values Values, which are replaced by their prefix sums
+ * @param num_values Number of values
+ */
+template <typename value_t>
+void prefix_sum(value_t* values, const vtkIdType num_values)
+{
+    const auto num_chunks = std::max(static_cast<vtkIdType>(1), std::min(static_cast<vtkIdType>(256), num_values / 65536));
+
+    if (num_chunks == 1)
+    {
+        std::partial_sum(values, values + num_values, values);
+        return;
+    }
+
+    auto chunk_begin = [num_values, num_chunks](const vtkIdType chunk) { return (chunk * num_values) / num_chunks; };
+
+    // Sum values of each chunk
+    std::vector<value_t> chunk_offsets(num_chunks + 1, value_t(0));
+
+    auto sum = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType chunk = begin; chunk < end; ++chunk)
+        {
+            chunk_offsets[chunk + 1] = std::accumulate(values + chunk_begin(chunk), values + chunk_begin(chunk + 1), value_t(0));
+        }
+    };
+
+    vtkSMPTools::For(0, num_chunks, sum);
+
+    std::partial_sum(chunk_offsets.begin(), chunk_offsets.end(), chunk_offsets.begin());
+
+    // Scan each chunk, starting from its offset
+    auto scan = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType chunk = begin; chunk < end; ++chunk)
+        {
+            auto running_sum = chunk_offsets[chunk];
+
+            for (auto index = chunk_begin(chunk); index < chunk_begin(chunk + 1); ++index)
+            {
+                running_sum += values[index];
+                values[index] = running_sum;
+            }
+        }
+    };
+
+    vtkSMPTools::For(0, num_chunks, scan);
+}
+
+template <typename value_t>
+void prefix_sum(std::vector<value_t>& values)
+{
+    prefix_sum(values.data(), static_cast<vtkIdType>(values.size()));
+}
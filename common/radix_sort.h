@@ -0,0 +1,114 @@
+#pragma once
+
+#include "vtkSMPTools.h"
+#include "vtkType.h"
+
+#include <algorithm>
+#include <array>
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+/**
+ * Stable parallel radix sort (least significant digit first) of unsigned 64-bit keys,
+ * reordering the associated values accordingly.
+ *
+ * The input is split into chunks, for which the digit histograms are computed in parallel.
+ * The prefix sum over all histograms then defines the target position of each key, such that
+ * the keys can be scattered in parallel while preserving their relative order.
+ *
+ * @param keys Keys, which are sorted in ascending order
+ * @param values Values associated with the keys, reordered with their keys
+ * @param num_bits Number of (least significant) key bits to consider for sorting
+ */
+template <typename value_t>
+void radix_sort(std::vector<std::uint64_t>& keys, std::vector<value_t>& values, const int num_bits = 64)
+{
+    constexpr int digit_bits = 8;
+    constexpr std::size_t num_buckets = 1 << digit_bits;
+
+    const auto num_keys = static_cast<vtkIdType>(keys.size());
+    const auto num_chunks = std::max(static_cast<vtkIdType>(1), std::min(static_cast<vtkIdType>(256), num_keys / 65536));
+
+    std::vector<std::uint64_t> temp_keys(keys.size());
+    std::vector<value_t> temp_values(values.size());
+
+    std::vector<std::array<vtkIdType, num_buckets>> histograms(num_chunks);
+
+    auto chunk_begin = [num_keys, num_chunks](const vtkIdType chunk) { return (chunk * num_keys) / num_chunks; };
+
+    for (int shift = 0; shift < num_bits; shift += digit_bits)
+    {
+        // Compute histogram of the current digit for each chunk
+        auto count = [&](const vtkIdType begin, const vtkIdType end)
+        {
+            for (vtkIdType chunk = begin; chunk < end; ++chunk)
+            {
+                histograms[chunk].fill(0);
+
+                for (auto index = chunk_begin(chunk); index < chunk_begin(chunk + 1); ++index)
+                {
+                    ++histograms[chunk][(keys[index] >> shift) & (num_buckets - 1)];
+                }
+            }
+        };
+
+        vtkSMPTools::For(0, num_chunks, count);
+
+        // Skip digits that are the same for all keys
+        bool constant_digit = false;
+
+        for (std::size_t bucket = 0; bucket < num_buckets && !constant_digit; ++bucket)
+        {
+            vtkIdType bucket_size = 0;
+
+            for (const auto& histogram : histograms)
+            {
+                bucket_size += histogram[bucket];
+            }
+
+            constant_digit = (bucket_size == num_keys);
+        }
+
+        if (constant_digit)
+        {
+            continue;
+        }
+
+        // Turn histograms into output positions, ordered by bucket first and chunk second for stability
+        vtkIdType position = 0;
+
+        for (std::size_t bucket = 0; bucket < num_buckets; ++bucket)
+        {
+            for (auto& histogram : histograms)
+            {
+                const auto bucket_size = histogram[bucket];
+
+                histogram[bucket] = position;
+                position += bucket_size;
+            }
+        }
+
+        // Scatter keys and values to their new position
+        auto scatter = [&](const vtkIdType begin, const vtkIdType end)
+        {
+            for (vtkIdType chunk = begin; chunk < end; ++chunk)
+            {
+                auto& positions = histograms[chunk];
+
+                for (auto index = chunk_begin(chunk); index < chunk_begin(chunk + 1); ++index)
+                {
+                    const auto target = positions[(keys[index] >> shift) & (num_buckets - 1)]++;
+
+                    temp_keys[target] = keys[index];
+                    temp_values[target] = values[index];
+                }
+            }
+        };
+
+        vtkSMPTools::For(0, num_chunks, scatter);
+
+        std::swap(keys, temp_keys);
+        std::swap(values, temp_values);
+    }
+}
@@ -13,14 +13,19 @@
 #include "vtkPointSet.h"
 #include "vtkPolyData.h"
 #include "vtkSmartPointer.h"
+#include "vtkSMPTools.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
+#include "common/iota_cells.h"
+#include "common/line_cells.h"
+
 #include "Eigen/Dense"
 
 #include <algorithm>
 #include <array>
 #include <cmath>
 #include <iostream>
+#include <limits>
 #include <numeric>
 #include <string>
 #include <utility>
@@ -31,7 +36,7 @@ vtkStandardNewMacro(b_spline);
 b_spline::b_spline()
 {
     this->SetNumberOfInputPorts(2);
-    this->SetNumberOfOutputPorts(1);
+    this->SetNumberOfOutputPorts(3);
 }
 
 int b_spline::FillInputPortInformation(int port, vtkInformation* info)
@@ -73,443 +78,1368 @@ int b_spline::RequestData(vtkInformation*, vtkInformationVector** input_vector,
         return 0;
     }
 
-    if (this->NumberOfPoints < this->Degree + 1)
+    if (this->Sampling < 0 || this->Sampling > 2)
     {
-        std::cerr << "The number of output points must be larger the B-spline degree" << std::endl;
+        std::cerr << "Invalid sampling method" << std::endl;
         return 0;
     }
 
-    if (input->GetNumberOfPoints() < this->Degree + 1)
+    if (this->Sampling == 2 && this->Tolerance <= 0.0)
     {
-        std::cerr << "Number of de Boor points must be larger than the B-spline degree" << std::endl;
+        std::cerr << "The tolerance for adaptive sampling must be positive" << std::endl;
+        return 0;
+    }
+
+    if (this->Fitting != 0 && this->NumberOfDeBoorPoints < this->Degree + 1)
+    {
+        std::cerr << "The number of fitted de Boor points must be larger than the B-spline degree" << std::endl;
+        return 0;
+    }
+
+    if (this->Sampling != 2 && this->NumberOfPoints < this->Degree + 1)
+    {
+        std::cerr << "The number of output points must be larger the B-spline degree" << std::endl;
         return 0;
     }
 
     const auto degree = static_cast<std::size_t>(this->Degree);
+
+    const auto kernels = select_kernels(degree);
+
     const auto hit_endpoints = this->HitEndpoints != 0;
+    const auto periodic = this->Periodic != 0;
     const auto num_output_points = static_cast<std::size_t>(this->NumberOfPoints);
 
-    // Get all de Boor points
-    const auto num_de_boor_points = static_cast<std::size_t>(input->GetPoints()->GetNumberOfPoints());
+    // Get de Boor points, creating one B-Spline per line for poly data with lines, and a single B-Spline otherwise
+    std::vector<std::vector<vtkIdType>> point_indices;
 
-    std::vector<Eigen::Vector3d> de_boor_points(num_de_boor_points);
+    auto* input_lines = vtkPolyData::SafeDownCast(input);
+
+    if (input_lines != nullptr && input_lines->GetNumberOfLines() > 0)
+    {
+        const line_view lines(input_lines->GetLines());
 
-    for (std::size_t i = 0; i < num_de_boor_points; ++i)
+        for (vtkIdType line = 0; line < lines.size(); ++line)
+        {
+            if (lines.size(line) >= this->Degree + 1)
+            {
+                point_indices.emplace_back(lines.begin(line), lines.end(line));
+            }
+        }
+    }
+    else if (input->GetNumberOfPoints() >= this->Degree + 1)
     {
-        input->GetPoints()->GetPoint(i, de_boor_points[i].data());
+        point_indices.emplace_back(input->GetNumberOfPoints());
+        std::iota(point_indices.front().begin(), point_indices.front().end(), 0);
     }
 
-    std::cout << "Number of input points: " << num_de_boor_points << std::endl;
+    if (point_indices.empty())
+    {
+        std::cerr << "Number of de Boor points must be larger than the B-spline degree" << std::endl;
+        return 0;
+    }
 
-    // Create knot vector
-    std::vector<double> knot_vector(num_de_boor_points + degree + 1);
+    const auto num_splines = static_cast<vtkIdType>(point_indices.size());
 
-    auto first = knot_vector.begin();
-    auto last = knot_vector.end();
+    std::vector<spline_t> splines(num_splines);
+    std::vector<unsigned char> valid(num_splines, 1);
 
-    if (hit_endpoints)
+    auto create_splines = [&](const vtkIdType begin, const vtkIdType end)
     {
-        // Use multiplicity of the first and last de Boor point
-        for (std::size_t i = 0; i < degree; ++i)
+        std::vector<Eigen::Vector3d> points;
+
+        for (vtkIdType index = begin; index < end; ++index)
         {
-            knot_vector[i] = 0.0;
-            knot_vector[knot_vector.size() - 1 - i] = static_cast<double>(num_de_boor_points - degree);
-        }
+            auto& spline = splines[index];
 
-        // Adjust iterators
-        first += degree;
-        last -= degree;
-    }
+            points.resize(point_indices[index].size());
 
-    std::iota(first, last, 0);
+            for (std::size_t i = 0; i < points.size(); ++i)
+            {
+                input->GetPoints()->GetPoint(point_indices[index][i], points[i].data());
+            }
 
-    std::cout << "Knot vector: " << print_collection(knot_vector.begin(), knot_vector.end()) << std::endl;
+            // Closed lines repeat their first point, which is reached by wrap-around for periodic B-splines
+            if (periodic && points.size() > 1 && points.front() == points.back())
+            {
+                points.pop_back();
+            }
 
-    // Create derivatives of the B-Spline
-    const auto de_boor_points_first_derivative = derive(de_boor_points, knot_vector.cbegin(), knot_vector.cend(), degree);
-    const auto de_boor_points_second_derivative = derive(de_boor_points_first_derivative, knot_vector.cbegin() + 1, knot_vector.cend() - 1, degree - 1);
+            if (this->Fitting != 0 && points.size() > static_cast<std::size_t>(this->NumberOfDeBoorPoints))
+            {
+                valid[index] = fit_spline(points, static_cast<std::size_t>(this->NumberOfDeBoorPoints), degree, hit_endpoints, periodic, spline);
+            }
+            else
+            {
+                spline.de_boor_points = points;
+                spline.knot_vector = create_knot_vector(spline.de_boor_points.size(), degree, hit_endpoints, periodic);
+            }
+        }
+    };
 
-    // Compute position at output points, with additional information
-    const auto u_begin = knot_vector[degree];
-    const auto u_end = knot_vector[num_de_boor_points];
-    const auto u_step = (u_end - u_begin) / (num_output_points - 1);
+    vtkSMPTools::For(0, num_splines, create_splines);
 
-    std::vector<Eigen::Vector3d> points(num_output_points);
-    std::vector<double> points_arc_position(num_output_points);
+    if (std::find(valid.begin(), valid.end(), 0) != valid.end())
+    {
+        std::cerr << "Least squares fitting failed, as the points are not distributed well enough for the number of de Boor points" << std::endl;
+        return 0;
+    }
 
-    std::vector<Eigen::Vector3d> tangent((degree > 2) ? num_output_points : 0);
-    std::vector<Eigen::Vector3d> binormal((degree > 2) ? num_output_points : 0);
-    std::vector<Eigen::Vector3d> normal((degree > 2) ? num_output_points : 0);
+    vtkDebugMacro(<< "Number of input points: " << input->GetNumberOfPoints());
+    vtkDebugMacro(<< "Number of B-splines: " << num_splines);
 
-    for (std::size_t i = 0; i < num_output_points; ++i)
+    if (num_splines == 1)
     {
-        auto u = u_begin + i * u_step;
+        vtkDebugMacro(<< "Knot vector: " << print_collection(splines.front().knot_vector.begin(), splines.front().knot_vector.end()));
+    }
 
-        points[i] = compute_point(de_boor_points, knot_vector.cbegin(), knot_vector.cend(), this->Degree, u);
-        points_arc_position[i] = u;
+    // Compute arc parameters of the output points
+    std::vector<std::vector<double>> arc_parameters(num_splines);
 
-        if (degree > 2)
+    auto sample = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType index = begin; index < end; ++index)
         {
-            tangent[i] = compute_point(de_boor_points_first_derivative, knot_vector.cbegin() + 1, knot_vector.cend() - 1, this->Degree - 1, u).normalized();
-            binormal[i] = tangent[i].cross(compute_point(de_boor_points_second_derivative, knot_vector.cbegin() + 2, knot_vector.cend() - 2, this->Degree - 2, u)).normalized();
-            normal[i] = tangent[i].cross(binormal[i]);
-        }
-    }
+            const auto& spline = splines[index];
+            auto& points_arc_position = arc_parameters[index];
 
-    // Calculate distance from the point to the output points
-    if (input_vector[1] != nullptr && input_vector[1]->GetInformationObject(0) != nullptr)
-    {
-        auto in_point_info = input_vector[1]->GetInformationObject(0);
-        auto input_point = vtkPointSet::SafeDownCast(in_point_info->Get(vtkDataObject::DATA_OBJECT()));
+            // Periodic B-splines end where they begin, for which a sample is added and removed afterwards
+            const auto num_samples = num_output_points + (periodic ? 1 : 0);
 
-        if (input_point->GetPoints()->GetNumberOfPoints() == 1)
-        {
-            double nearest_arc;
-            double nearest_distance;
+            if (this->Sampling == 1)
+            {
+                compute_arc_length_parameters(spline, degree, kernels, num_samples, points_arc_position);
+            }
+            else if (this->Sampling == 2)
+            {
+                compute_adaptive_parameters(spline, degree, this->Tolerance, points_arc_position);
+            }
+            else
+            {
+                const auto u_begin = spline.knot_vector[degree];
+                const auto u_end = spline.knot_vector[get_num_de_boor_points(spline.knot_vector.cbegin(), spline.knot_vector.cend(), degree)];
+                const auto u_step = (u_end - u_begin) / (num_samples - 1);
 
-            // Get point
-            Eigen::Vector3d point;
-            input_point->GetPoints()->GetPoint(0, point.data());
+                points_arc_position.resize(num_samples);
 
-            // Use middle of each segment as starting point
-            std::vector<std::pair<double, double>> distances(num_de_boor_points - degree);
+                for (std::size_t i = 0; i < num_samples; ++i)
+                {
+                    points_arc_position[i] = u_begin + i * u_step;
+                }
+            }
 
-            auto comparator = [](const std::pair<double, double>& lhs, const std::pair<double, double>& rhs) -> bool
+            if (periodic)
             {
-                return lhs.second < rhs.second;
-            };
+                points_arc_position.pop_back();
+            }
+        }
+    };
 
-            const double delta = knot_vector[degree + 1] - knot_vector[degree];
+    vtkSMPTools::For(0, num_splines, sample);
 
-            std::transform(knot_vector.begin() + degree, knot_vector.begin() + num_de_boor_points, distances.begin(),
-                [this, &de_boor_points, &knot_vector, &point, delta](double u) -> std::pair<double, double>
-                {
-                    return std::make_pair(u + 0.5, (point - compute_point(de_boor_points, knot_vector.cbegin(), knot_vector.cend(), this->Degree, u + 0.5 * delta)).norm());
-                });
+    // Compute output offsets of the B-splines
+    std::vector<vtkIdType> output_offsets(num_splines + 1, 0);
 
-            std::cout << "Initial guess: " << print_collection(distances.begin(), distances.end()) << std::endl;
+    for (vtkIdType index = 0; index < num_splines; ++index)
+    {
+        output_offsets[index + 1] = output_offsets[index] + static_cast<vtkIdType>(arc_parameters[index].size());
+    }
 
-            if (degree == 2)
-            {
-                // Try to find a local minimum by finding the roots of the derivative of the distance polynomial
-                // This means, we find the minimum by looking for the root of the derivative
-                for (auto distance_it = distances.begin(); distance_it != distances.end(); ++distance_it)
-                {
-                    // Get index
-                    const auto index = degree + static_cast<std::size_t>(std::floor((distance_it->first - u_begin) / delta));
-
-                    // Get analytical derivative...
-                    // ... calculate denominators
-                    const double alpha =
-                        +knot_vector[index + 2] * knot_vector[index + 1]
-                        - knot_vector[index + 2] * knot_vector[index + 0]
-                        - knot_vector[index + 1] * knot_vector[index + 0]
-                        + knot_vector[index + 0] * knot_vector[index + 0];
-
-                    const double gamma =
-                        +knot_vector[index + 1] * knot_vector[index + 1]
-                        - knot_vector[index + 1] * knot_vector[index + 0]
-                        - knot_vector[index + 1] * knot_vector[index - 1]
-                        + knot_vector[index + 0] * knot_vector[index - 1];
-
-                    // ... bring B-Spline into the form au + bu + c
-                    const auto a = (
-                        +alpha * de_boor_points[index - 2]
-                        - alpha * de_boor_points[index - 1]
-                        - gamma * de_boor_points[index - 1]
-                        + gamma * de_boor_points[index - 0]) / (alpha * gamma);
-
-                    const auto b = (
-                        -2.0 * alpha * knot_vector[index + 1] * de_boor_points[index - 2]
-                        + alpha * knot_vector[index + 1] * de_boor_points[index - 1]
-                        + alpha * knot_vector[index - 1] * de_boor_points[index - 1]
-                        + gamma * knot_vector[index + 2] * de_boor_points[index - 1]
-                        + gamma * knot_vector[index + 0] * de_boor_points[index - 1]
-                        - 2.0 * gamma * knot_vector[index + 0] * de_boor_points[index - 0]) / (alpha * gamma);
-
-                    const auto c = (
-                        +alpha * knot_vector[index + 1] * knot_vector[index + 1] * de_boor_points[index - 2]
-                        - alpha * knot_vector[index + 1] * knot_vector[index - 1] * de_boor_points[index - 1]
-                        - gamma * knot_vector[index + 2] * knot_vector[index + 0] * de_boor_points[index - 1]
-                        + gamma * knot_vector[index + 0] * knot_vector[index + 0] * de_boor_points[index - 0]) / (alpha * gamma);
-
-                    // ... create polynomial relative to p by setting (s(u) - p) as au + bu + c_dist
-                    const auto c_dist = c - point;
-
-                    // ... create distance polynomial of form vu^4 + wu^3 + xu^2 + yu + z as (s(u) - p)*(s(u) - p)
-                    const auto v = a.dot(a);
-                    const auto w = 2.0 * a.dot(b);
-                    const auto x = 2.0 * a.dot(c_dist) + b.dot(b);
-                    const auto y = 2.0 * b.dot(c_dist);
-                    const auto z = c_dist.dot(c_dist);
-
-                    // ... calculate first derivative of form 4vu^3 + 3wu^2 + 2xu + y = v'u^3 + w'u^2 + x'u + y'
-                    const auto v_dash = 4.0 * v;
-                    const auto w_dash = 3.0 * w;
-                    const auto x_dash = 2.0 * x;
-                    const auto y_dash = 1.0 * y;
-
-                    // ... calculate second derivative of form 12vu^2 + 6wu + 2x = v''u^2 + w''u + x''
-                    const auto v_dash_dash = 12.0 * v;
-                    const auto w_dash_dash = 6.0 * w;
-                    const auto x_dash_dash = 2.0 * x;
-
-                    // Use Newton's method to find the root of the first derivative
-                    auto u = distance_it->first;
-
-                    const auto u_left = u - 0.5 * delta;
-                    const auto u_right = u + 0.5 * delta;
-
-                    for (std::size_t i = 0; i < 10; ++i)
-                    {
-                        // Calculate derivatives by inserting u
-                        const auto first_derivative = v_dash * std::pow(u, 3.0) + w_dash * std::pow(u, 2.0) + x_dash * u + y_dash;
-                        const auto second_derivative = v_dash_dash * std::pow(u, 2.0) + w_dash_dash * u + x_dash_dash;
+    const auto num_total_output_points = output_offsets.back();
 
-                        // Improve previous position
-                        u -= first_derivative / second_derivative;
-                    }
+    // Create output arrays
+    auto output_point_coordinates = vtkSmartPointer<vtkFloatArray>::New();
+    output_point_coordinates->SetNumberOfComponents(3);
+    output_point_coordinates->SetNumberOfTuples(num_total_output_points);
+
+    auto output_arc_positions = vtkSmartPointer<vtkFloatArray>::New();
+    output_arc_positions->SetNumberOfComponents(1);
+    output_arc_positions->SetNumberOfTuples(num_total_output_points);
+    output_arc_positions->SetName("Parametric Position");
 
-                    // Calculate other roots analytically
-                    double u_2, u_3;
-                    u_2 = u_3 = u;
+    auto output_tangent = vtkSmartPointer<vtkFloatArray>::New();
+    output_tangent->SetNumberOfComponents(3);
+    output_tangent->SetName("Tangent");
 
-                    const auto a_reduced = v_dash;
-                    const auto b_reduced = w_dash + u * a_reduced;
-                    const auto c_reduced = x_dash + u * b_reduced;
+    auto output_binormal = vtkSmartPointer<vtkFloatArray>::New();
+    output_binormal->SetNumberOfComponents(3);
+    output_binormal->SetName("Binormal");
 
-                    const auto discriminant = b_reduced * b_reduced - 4.0 * a_reduced * c_reduced;
+    auto output_normal = vtkSmartPointer<vtkFloatArray>::New();
+    output_normal->SetNumberOfComponents(3);
+    output_normal->SetName("Normal");
 
-                    if (fabsf(a_reduced) > delta&& discriminant > 0.0)
-                    {
-                        u_2 = (-b_reduced + sqrtf(discriminant)) / (2.0 * a_reduced);
-                        u_3 = (-b_reduced - sqrtf(discriminant)) / (2.0 * a_reduced);
-                    }
+    if (degree > 2)
+    {
+        output_tangent->SetNumberOfTuples(num_total_output_points);
+        output_binormal->SetNumberOfTuples(num_total_output_points);
+        output_normal->SetNumberOfTuples(num_total_output_points);
+    }
 
-                    // "Clamp" u to the range [u_left, u_right]
-                    if (u < u_left || u > u_right) u = u_left;
-                    if (u_2 < u_left || u_2 > u_right) u_2 = u_left;
-                    if (u_3 < u_left || u_3 > u_right) u_3 = u_left;
-
-                    // Additionally get distances at the boundaries of the segment
-                    const std::array<double, 5> us{
-                        u,
-                        u_2,
-                        u_3,
-                        u_left,
-                        u_right
-                    };
-
-                    const std::array<double, 5> distances{
-                        (point - (us[0] * us[0] * a + us[0] * b + c)).norm(),
-                        (point - (us[1] * us[1] * a + us[1] * b + c)).norm(),
-                        (point - (us[2] * us[2] * a + us[2] * b + c)).norm(),
-                        (point - (us[3] * us[3] * a + us[3] * b + c)).norm(),
-                        (point - (us[4] * us[4] * a + us[4] * b + c)).norm()
-                    };
-
-                    // Find smallest distance from the distances at the roots of the derivatives and the boundaries
-                    // Set new smallest distance accordingly
-                    distance_it->first = us[0];
-                    distance_it->second = distances[0];
-
-                    for (int i = 1; i < 5; ++i)
-                    {
-                        if (distances[i] < distance_it->second)
-                        {
-                            distance_it->first = us[i];
-                            distance_it->second = distances[i];
-                        }
-                    }
-                }
-            }
-            else if (degree > 2)
+    auto* point_values = output_point_coordinates->GetPointer(0);
+    auto* arc_position_values = output_arc_positions->GetPointer(0);
+    auto* tangent_values = output_tangent->GetPointer(0);
+    auto* binormal_values = output_binormal->GetPointer(0);
+    auto* normal_values = output_normal->GetPointer(0);
+
+    // Compute position at output points, with additional information
+    auto evaluate = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        std::vector<Eigen::Vector3d> points, first_derivatives, second_derivatives;
+
+        for (vtkIdType index = begin; index < end; ++index)
+        {
+            const auto& spline = splines[index];
+            const auto& points_arc_position = arc_parameters[index];
+            const auto offset = output_offsets[index];
+
+            compute_points(spline.de_boor_points, spline.knot_vector.cbegin(), spline.knot_vector.cend(), degree, kernels,
+                points_arc_position, points, first_derivatives, second_derivatives);
+
+            for (std::size_t i = 0; i < points_arc_position.size(); ++i)
             {
-                // Find the local minimum by linear subdivision
-                for (auto distance_it = distances.begin(); distance_it != distances.end(); ++distance_it)
-                {
-                    // Get index and start at the center of the segment
-                    const auto index = degree + static_cast<std::size_t>(std::floor((distance_it->first - u_begin) / delta));
+                const auto point_index = offset + static_cast<vtkIdType>(i);
+
+                arc_position_values[point_index] = static_cast<float>(points_arc_position[i]);
 
-                    auto u = distance_it->first;
-                    auto u_left = u - 0.5 * delta;
-                    auto u_right = u + 0.5 * delta;
+                for (int c = 0; c < 3; ++c)
+                {
+                    point_values[point_index * 3 + c] = static_cast<float>(points[i][c]);
+                }
 
-                    // Loop a few times
-                    bool good_match = false;
+                if (degree > 2)
+                {
+                    const Eigen::Vector3d tangent = first_derivatives[i].normalized();
+                    const Eigen::Vector3d binormal = tangent.cross(second_derivatives[i]).normalized();
+                    const Eigen::Vector3d normal = tangent.cross(binormal);
 
-                    for (std::size_t i = 0; i < 10 && !good_match; ++i)
+                    for (int c = 0; c < 3; ++c)
                     {
-                        // The subdivision plane is defined by the position and the tangent at u
-                        const auto position = compute_point(de_boor_points, knot_vector.cbegin(), knot_vector.cend(), this->Degree, u);
-                        const auto tangent = compute_point(de_boor_points_first_derivative, knot_vector.cbegin() + 1, knot_vector.cend() - 1, this->Degree - 1, u);
-
-                        const auto direction = tangent.dot(point - position);
-
-                        if (std::abs(direction) < 0.0001)
-                        {
-                            good_match = true;
-                        }
-                        else if (direction > 0.0)
-                        {
-                            // In front of the plane
-                            u_left = u;
-                        }
-                        else
-                        {
-                            // Behind the plane
-                            u_right = u;
-                        }
-
-                        u = 0.5 * (u_left + u_right);
+                        tangent_values[point_index * 3 + c] = static_cast<float>(tangent[c]);
+                        binormal_values[point_index * 3 + c] = static_cast<float>(binormal[c]);
+                        normal_values[point_index * 3 + c] = static_cast<float>(normal[c]);
                     }
-
-                    distance_it->first = u;
-                    distance_it->second = (point - compute_point(de_boor_points, knot_vector.cbegin(), knot_vector.cend(), this->Degree, u)).norm();
                 }
             }
+        }
+    };
 
-            // Pick best of the results
-            std::tie(nearest_arc, nearest_distance) = *std::min_element(distances.begin(), distances.end(), comparator);
+    vtkSMPTools::For(0, num_splines, evaluate);
 
-            const auto position = compute_point(de_boor_points, knot_vector.cbegin(), knot_vector.cend(), this->Degree, nearest_arc);
+    // Calculate closest points on the B-splines for all query points
+    auto* closest_output = vtkPolyData::SafeDownCast(output_vector->GetInformationObject(1)->Get(vtkDataObject::DATA_OBJECT()));
 
-            std::cout << "Resulting distances: " << print_collection(distances.begin(), distances.end()) << std::endl;
+    if (input_vector[1] != nullptr && input_vector[1]->GetInformationObject(0) != nullptr)
+    {
+        auto in_point_info = input_vector[1]->GetInformationObject(0);
+        auto input_points = vtkPointSet::SafeDownCast(in_point_info->Get(vtkDataObject::DATA_OBJECT()));
 
-            // Output result
-            std::cout << "Closest point at arc: " << nearest_arc << std::endl;
-            std::cout << "Closest point position: [" << position[0] << ", " << position[1] << ", " << position[2] << "]" << std::endl;
-            std::cout << "Distance: " << nearest_distance << std::endl;
+        if (input_points != nullptr && input_points->GetPoints() != nullptr)
+        {
+            compute_closest_points(splines, degree, kernels, input_points, closest_output);
         }
     }
 
     // Set output points
     auto output_points = vtkSmartPointer<vtkPoints>::New();
-    output_points->SetNumberOfPoints(points.size());
+    output_points->SetData(output_point_coordinates);
+
+    output->SetPoints(output_points);
+
+    // Set arrays storing the arc position and the orientation at each point
+    output->GetPointData()->AddArray(output_arc_positions);
 
-    for (std::size_t i = 0; i < points.size(); ++i)
+    if (degree > 2)
     {
-        output_points->SetPoint(i, points[i].data());
+        output->GetPointData()->AddArray(output_tangent);
+        output->GetPointData()->AddArray(output_binormal);
+        output->GetPointData()->AddArray(output_normal);
     }
 
-    output->SetPoints(output_points);
+    // Set output lines, closing them for periodic B-splines by repeating the first point index
+    line_builder lines(num_splines);
 
-    // Create array storing the arc position at each point
-    auto output_arc_positions = vtkSmartPointer<vtkFloatArray>::New();
-    output_arc_positions->SetNumberOfComponents(1);
-    output_arc_positions->SetNumberOfTuples(points_arc_position.size());
-    output_arc_positions->SetName("Parametric Position");
+    for (vtkIdType index = 0; index < num_splines; ++index)
+    {
+        lines.set_size(index, output_offsets[index + 1] - output_offsets[index] + (periodic ? 1 : 0));
+    }
+
+    lines.allocate();
+
+    auto write_lines = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType index = begin; index < end; ++index)
+        {
+            std::iota(lines.begin(index), lines.begin(index) + (output_offsets[index + 1] - output_offsets[index]), output_offsets[index]);
+
+            if (periodic)
+            {
+                lines.begin(index)[lines.size(index) - 1] = output_offsets[index];
+            }
+        }
+    };
+
+    vtkSMPTools::For(0, num_splines, write_lines);
 
-    for (std::size_t i = 0; i < points_arc_position.size(); ++i)
+    output->SetLines(lines.build());
+
+    // Set de Boor points as third output
+    auto* de_boor_output = vtkPolyData::SafeDownCast(output_vector->GetInformationObject(2)->Get(vtkDataObject::DATA_OBJECT()));
+
+    line_builder de_boor_lines(num_splines);
+
+    for (vtkIdType index = 0; index < num_splines; ++index)
     {
-        output_arc_positions->SetValue(i, points_arc_position[i]);
+        de_boor_lines.set_size(index, static_cast<vtkIdType>(splines[index].de_boor_points.size()) + (periodic ? 1 : 0));
     }
 
-    output->GetPointData()->AddArray(output_arc_positions);
+    de_boor_lines.allocate();
 
-    // Create arrays storing the orientation at each point
-    if (degree > 2)
+    std::vector<vtkIdType> de_boor_offsets(num_splines + 1, 0);
+
+    for (vtkIdType index = 0; index < num_splines; ++index)
     {
-        auto output_tangent = vtkSmartPointer<vtkFloatArray>::New();
-        output_tangent->SetNumberOfComponents(3);
-        output_tangent->SetNumberOfTuples(points_arc_position.size());
-        output_tangent->SetName("Tangent");
+        de_boor_offsets[index + 1] = de_boor_offsets[index] + static_cast<vtkIdType>(splines[index].de_boor_points.size());
+    }
 
-        auto output_binormal = vtkSmartPointer<vtkFloatArray>::New();
-        output_binormal->SetNumberOfComponents(3);
-        output_binormal->SetNumberOfTuples(points_arc_position.size());
-        output_binormal->SetName("Binormal");
+    auto de_boor_point_coordinates = vtkSmartPointer<vtkFloatArray>::New();
+    de_boor_point_coordinates->SetNumberOfComponents(3);
+    de_boor_point_coordinates->SetNumberOfTuples(de_boor_offsets.back());
 
-        auto output_normal = vtkSmartPointer<vtkFloatArray>::New();
-        output_normal->SetNumberOfComponents(3);
-        output_normal->SetNumberOfTuples(points_arc_position.size());
-        output_normal->SetName("Normal");
+    auto* de_boor_values = de_boor_point_coordinates->GetPointer(0);
 
-        for (std::size_t i = 0; i < points_arc_position.size(); ++i)
+    auto write_de_boor_points = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType index = begin; index < end; ++index)
         {
-            output_tangent->SetTuple(i, tangent[i].data());
-            output_binormal->SetTuple(i, binormal[i].data());
-            output_normal->SetTuple(i, normal[i].data());
+            const auto& de_boor_points = splines[index].de_boor_points;
+
+            for (std::size_t i = 0; i < de_boor_points.size(); ++i)
+            {
+                for (int c = 0; c < 3; ++c)
+                {
+                    de_boor_values[(de_boor_offsets[index] + i) * 3 + c] = static_cast<float>(de_boor_points[i][c]);
+                }
+            }
+
+            std::iota(de_boor_lines.begin(index), de_boor_lines.begin(index) + de_boor_points.size(), de_boor_offsets[index]);
+
+            if (periodic)
+            {
+                de_boor_lines.begin(index)[de_boor_points.size()] = de_boor_offsets[index];
+            }
         }
+    };
 
-        output->GetPointData()->AddArray(output_tangent);
-        output->GetPointData()->AddArray(output_binormal);
-        output->GetPointData()->AddArray(output_normal);
+    vtkSMPTools::For(0, num_splines, write_de_boor_points);
+
+    auto de_boor_output_points = vtkSmartPointer<vtkPoints>::New();
+    de_boor_output_points->SetData(de_boor_point_coordinates);
+
+    de_boor_output->SetPoints(de_boor_output_points);
+    de_boor_output->SetLines(de_boor_lines.build());
+
+    return 1;
+}
+
+bool b_spline::fit_spline(const std::vector<Eigen::Vector3d>& points, const std::size_t num_de_boor_points,
+    const std::size_t degree, const bool hit_endpoints, const bool periodic, spline_t& spline) const
+{
+    if (periodic)
+    {
+        return fit_periodic_spline(points, num_de_boor_points, degree, spline);
     }
 
-    // Set output line
-    auto indices = vtkSmartPointer<vtkIdTypeArray>::New();
-    indices->SetNumberOfComponents(1);
-    indices->SetNumberOfTuples(points.size() + 1);
+    const auto num_points = points.size();
 
-    indices->SetValue(0, points.size());
+    spline.knot_vector = create_knot_vector(num_de_boor_points, degree, hit_endpoints, false);
 
-    for (std::size_t i = 0; i < points.size(); ++i)
+    const auto u_begin = spline.knot_vector[degree];
+    const auto u_end = spline.knot_vector[num_de_boor_points];
+
+    // Parameterize the points by chord length
+    std::vector<double> parameters(num_points, 0.0);
+
+    for (std::size_t i = 1; i < num_points; ++i)
+    {
+        parameters[i] = parameters[i - 1] + (points[i] - points[i - 1]).norm();
+    }
+
+    const auto total_length = parameters.back();
+
+    for (std::size_t i = 0; i < num_points; ++i)
     {
-        indices->SetValue(i + 1, i);
+        parameters[i] = u_begin + (u_end - u_begin) * ((total_length > 0.0) ? (parameters[i] / total_length) : (static_cast<double>(i) / (num_points - 1)));
     }
 
-    auto cell = vtkSmartPointer<vtkCellArray>::New();
-    cell->SetCells(1, indices);
+    parameters.back() = u_end;
 
-    output->SetLines(cell);
+    // Place the inner knots by averaging the parameters, such that every knot span contains points,
+    // following equation 9.69 in "The NURBS Book" by Piegl and Tiller; keep uniform knots if this fails
+    std::vector<double> inner_knots(num_de_boor_points - degree - 1);
 
-    return 1;
+    const auto step = static_cast<double>(num_points) / (num_de_boor_points - degree);
+
+    for (std::size_t j = 1; j < num_de_boor_points - degree; ++j)
+    {
+        const auto i = static_cast<std::size_t>(j * step);
+        const auto alpha = j * step - i;
+
+        inner_knots[j - 1] = (1.0 - alpha) * parameters[i - 1] + alpha * parameters[i];
+    }
+
+    bool increasing = true;
+
+    for (std::size_t j = 0; j <= inner_knots.size(); ++j)
+    {
+        const auto previous = (j == 0) ? u_begin : inner_knots[j - 1];
+        const auto next = (j == inner_knots.size()) ? u_end : inner_knots[j];
+
+        increasing &= previous < next;
+    }
+
+    if (increasing)
+    {
+        std::copy(inner_knots.begin(), inner_knots.end(), spline.knot_vector.begin() + degree + 1);
+    }
+
+    // Assemble the normal equations, which are banded with the degree as half bandwidth, storing the lower band
+    const auto bandwidth = degree + 1;
+
+    std::vector<double> matrix(num_de_boor_points * bandwidth, 0.0);
+    std::vector<Eigen::Vector3d> right_hand_side(num_de_boor_points, Eigen::Vector3d{ 0.0, 0.0, 0.0 });
+    std::vector<double> basis(bandwidth);
+
+    for (std::size_t i = 0; i < num_points; ++i)
+    {
+        const auto span = find_span(spline.knot_vector.cbegin(), num_de_boor_points, degree, parameters[i]);
+
+        compute_basis_functions(spline.knot_vector.cbegin(), degree, span, parameters[i], basis.data());
+
+        for (std::size_t j = 0; j <= degree; ++j)
+        {
+            const auto row = span - degree + j;
+
+            right_hand_side[row] += basis[j] * points[i];
+
+            for (std::size_t k = 0; k <= j; ++k)
+            {
+                matrix[row * bandwidth + (j - k)] += basis[j] * basis[k];
+            }
+        }
+    }
+
+    // Solve using the Cholesky decomposition of the banded matrix
+    if (!solve_banded(matrix, num_de_boor_points, degree, right_hand_side))
+    {
+        return false;
+    }
+
+    spline.de_boor_points = right_hand_side;
+
+    return true;
 }
 
-Eigen::Vector3d b_spline::compute_point(const std::vector<Eigen::Vector3d>& de_boor_points,
-    std::vector<double>::const_iterator knot_vector, std::vector<double>::const_iterator knot_vector_end,
-    const std::size_t degree, double arc_parameter) const
+bool b_spline::fit_periodic_spline(const std::vector<Eigen::Vector3d>& points, const std::size_t num_de_boor_points,
+    const std::size_t degree, spline_t& spline) const
 {
-    Eigen::Vector3d point{ 0.0, 0.0, 0.0 };
+    const auto num_points = points.size();
+
+    spline.knot_vector = create_knot_vector(num_de_boor_points, degree, false, true);
+
+    const auto u_begin = spline.knot_vector[degree];
+    const auto u_end = spline.knot_vector[num_de_boor_points + degree];
+
+    // Parameterize the points by chord length along the closed polygon
+    std::vector<double> parameters(num_points, 0.0);
+
+    for (std::size_t i = 1; i < num_points; ++i)
+    {
+        parameters[i] = parameters[i - 1] + (points[i] - points[i - 1]).norm();
+    }
+
+    const auto total_length = parameters.back() + (points.front() - points.back()).norm();
+
+    for (std::size_t i = 0; i < num_points; ++i)
+    {
+        parameters[i] = u_begin + (u_end - u_begin) * ((total_length > 0.0) ? (parameters[i] / total_length) : (static_cast<double>(i) / num_points));
+    }
+
+    // Assemble the normal equations, which are banded except for the corners coupling the wrapped-around de Boor points
+    Eigen::MatrixXd matrix = Eigen::MatrixXd::Zero(num_de_boor_points, num_de_boor_points);
+    Eigen::MatrixXd right_hand_side = Eigen::MatrixXd::Zero(num_de_boor_points, 3);
+    std::vector<double> basis(degree + 1);
 
-    if (arc_parameter >= access_at(knot_vector, de_boor_points.size()))
+    for (std::size_t i = 0; i < num_points; ++i)
     {
-        arc_parameter = access_at(knot_vector, de_boor_points.size()) - 0.0001f;
+        const auto span = find_span(spline.knot_vector.cbegin(), num_de_boor_points + degree, degree, parameters[i]);
+
+        compute_basis_functions(spline.knot_vector.cbegin(), degree, span, parameters[i], basis.data());
+
+        for (std::size_t j = 0; j <= degree; ++j)
+        {
+            const auto row = (span - degree + j) % num_de_boor_points;
+
+            right_hand_side.row(row) += basis[j] * points[i].transpose();
+
+            for (std::size_t k = 0; k <= degree; ++k)
+            {
+                matrix(row, (span - degree + k) % num_de_boor_points) += basis[j] * basis[k];
+            }
+        }
     }
 
-    for (std::size_t j = 0; j < de_boor_points.size(); ++j)
+    // Solve using the dense Cholesky decomposition, which is affordable for the small number of fitted de Boor points
+    const Eigen::LLT<Eigen::MatrixXd> decomposition(matrix);
+
+    if (decomposition.info() != Eigen::Success)
     {
-        const auto N = basis_function(knot_vector, knot_vector_end, j, degree, arc_parameter);
+        return false;
+    }
 
-        point[0] += N * de_boor_points[j][0];
-        point[1] += N * de_boor_points[j][1];
-        point[2] += N * de_boor_points[j][2];
+    const Eigen::MatrixXd solution = decomposition.solve(right_hand_side);
+
+    spline.de_boor_points.resize(num_de_boor_points);
+
+    for (std::size_t index = 0; index < num_de_boor_points; ++index)
+    {
+        spline.de_boor_points[index] = solution.row(index).transpose();
     }
 
-    return point;
+    return true;
 }
 
-double b_spline::basis_function(std::vector<double>::const_iterator knot_vector, std::vector<double>::const_iterator knot_vector_end,
-    const std::size_t de_boor_index, const std::size_t degree, const double u) const
+void b_spline::compute_basis_functions(std::vector<double>::const_iterator knot_vector, const std::size_t degree,
+    const std::size_t span, const double u, double* basis) const
 {
-    // 1 if u_i <= u < u_i+1, 0 otherwise
-    if (degree == 0)
+    // Compute the non-zero basis functions, following algorithm A2.2 in "The NURBS Book" by Piegl and Tiller
+    std::vector<double> left(degree + 1), right(degree + 1);
+
+    basis[0] = 1.0;
+
+    for (std::size_t j = 1; j <= degree; ++j)
     {
-        return (access_at(knot_vector, de_boor_index) <= u && u < access_at(knot_vector, de_boor_index + 1)) ? 1.0 : 0.0;
-    }
+        left[j] = u - access_at(knot_vector, span + 1 - j);
+        right[j] = access_at(knot_vector, span + j) - u;
 
-    // Calculate recursively
-    const auto Ni = basis_function(knot_vector, knot_vector_end, de_boor_index, degree - 1, u);
-    const auto Nip1 = basis_function(knot_vector, knot_vector_end, de_boor_index + 1, degree - 1, u);
+        double saved = 0.0;
+
+        for (std::size_t r = 0; r < j; ++r)
+        {
+            const auto temp = basis[r] / (right[r + 1] + left[j - r]);
 
-    const auto part_1 = (access_at(knot_vector, de_boor_index + degree) - access_at(knot_vector, de_boor_index) == 0.0) ? 0.0 :
-        ((u - access_at(knot_vector, de_boor_index)) / (access_at(knot_vector, de_boor_index + degree) - access_at(knot_vector, de_boor_index)));
-    const auto part_2 = (access_at(knot_vector, de_boor_index + degree + 1) - access_at(knot_vector, de_boor_index + 1) == 0.0) ? 0.0 :
-        ((access_at(knot_vector, de_boor_index + degree + 1) - u) / (access_at(knot_vector, de_boor_index + degree + 1) - access_at(knot_vector, de_boor_index + 1)));
+            basis[r] = saved + right[r + 1] * temp;
+            saved = left[j - r] * temp;
+        }
 
-    return part_1 * Ni + part_2 * Nip1;
+        basis[j] = saved;
+    }
 }
 
-std::vector<Eigen::Vector3d> b_spline::derive(const std::vector<Eigen::Vector3d>& de_boor_points,
-    std::vector<double>::const_iterator knot_vector, std::vector<double>::const_iterator knot_vector_end, const std::size_t degree) const
+bool b_spline::solve_banded(std::vector<double>& matrix, const std::size_t size, const std::size_t half_bandwidth,
+    std::vector<Eigen::Vector3d>& right_hand_side) const
 {
-    std::vector<Eigen::Vector3d> derived_de_boor_points(de_boor_points.size() - 1);
+    // The lower band is stored row-wise, with entry (i, i - k) at position i * (half_bandwidth + 1) + k
+    const auto bandwidth = half_bandwidth + 1;
+
+    auto entry = [&matrix, bandwidth](const std::size_t i, const std::size_t j) -> double& { return matrix[i * bandwidth + (i - j)]; };
+
+    // Decompose in place into L L^T
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        const auto first = (i > half_bandwidth) ? (i - half_bandwidth) : 0;
+
+        for (auto j = first; j <= i; ++j)
+        {
+            auto sum = entry(i, j);
+
+            for (auto k = first; k < j; ++k)
+            {
+                sum -= entry(i, k) * entry(j, k);
+            }
+
+            if (j == i)
+            {
+                if (sum <= 0.0)
+                {
+                    return false;
+                }
+
+                entry(i, i) = std::sqrt(sum);
+            }
+            else
+            {
+                entry(i, j) = sum / entry(j, j);
+            }
+        }
+    }
+
+    // Forward substitution with L
+    for (std::size_t i = 0; i < size; ++i)
+    {
+        const auto first = (i > half_bandwidth) ? (i - half_bandwidth) : 0;
+
+        for (auto k = first; k < i; ++k)
+        {
+            right_hand_side[i] -= entry(i, k) * right_hand_side[k];
+        }
+
+        right_hand_side[i] /= entry(i, i);
+    }
+
+    // Backward substitution with L^T
+    for (std::size_t i = size; i-- > 0;)
+    {
+        const auto last = std::min(size - 1, i + half_bandwidth);
+
+        for (auto k = i + 1; k <= last; ++k)
+        {
+            right_hand_side[i] -= entry(k, i) * right_hand_side[k];
+        }
+
+        right_hand_side[i] /= entry(i, i);
+    }
+
+    return true;
+}
+
+std::vector<double> b_spline::create_knot_vector(const std::size_t num_de_boor_points, const std::size_t degree,
+    const bool hit_endpoints, const bool periodic) const
+{
+    if (periodic)
+    {
+        // Uniform knots for the de Boor points, followed by the first degree de Boor points again
+        std::vector<double> knot_vector(num_de_boor_points + 2 * degree + 1);
+        std::iota(knot_vector.begin(), knot_vector.end(), 0);
+
+        return knot_vector;
+    }
+
+    std::vector<double> knot_vector(num_de_boor_points + degree + 1);
+
+    auto first = knot_vector.begin();
+    auto last = knot_vector.end();
+
+    if (hit_endpoints)
+    {
+        // Use multiplicity of the first and last de Boor point
+        for (std::size_t i = 0; i < degree; ++i)
+        {
+            knot_vector[i] = 0.0;
+            knot_vector[knot_vector.size() - 1 - i] = static_cast<double>(num_de_boor_points - degree);
+        }
+
+        // Adjust iterators
+        first += degree;
+        last -= degree;
+    }
+
+    std::iota(first, last, 0);
+
+    return knot_vector;
+}
+
+void b_spline::compute_arc_length_parameters(const spline_t& spline, const std::size_t degree, const kernels_t& kernels,
+    const std::size_t num_samples, std::vector<double>& arc_parameters) const
+{
+    constexpr std::size_t num_subdivisions = 4;
+
+    const auto num_de_boor_points = get_num_de_boor_points(spline.knot_vector.cbegin(), spline.knot_vector.cend(), degree);
+    const auto num_spans = num_de_boor_points - degree;
+
+    // Create cumulative arc length table, subdividing each span
+    std::vector<std::vector<Eigen::Vector3d>> coefficients(num_spans);
+
+    std::vector<double> table_u(num_spans * num_subdivisions + 1);
+    std::vector<double> table_length(num_spans * num_subdivisions + 1);
+
+    table_u[0] = spline.knot_vector[degree];
+    table_length[0] = 0.0;
+
+    for (std::size_t span = 0; span < num_spans; ++span)
+    {
+        compute_span_coefficients(spline.de_boor_points, spline.knot_vector.cbegin(), degree, kernels, span + degree, coefficients[span]);
+
+        const auto u_begin = spline.knot_vector[span + degree];
+        const auto u_end = spline.knot_vector[span + degree + 1];
+
+        for (std::size_t i = 0; i < num_subdivisions; ++i)
+        {
+            const auto index = span * num_subdivisions + i;
+
+            table_u[index + 1] = u_begin + (u_end - u_begin) * (i + 1) / num_subdivisions;
+            table_length[index + 1] = table_length[index] + compute_arc_length(coefficients[span], degree, kernels, u_begin, table_u[index], table_u[index + 1]);
+        }
+    }
+
+    // Place samples at equal arc length, searching the table monotonically as the target lengths are ascending
+    const auto total_length = table_length.back();
+
+    arc_parameters.resize(num_samples);
+
+    std::size_t index = 0;
+
+    for (std::size_t sample = 0; sample < num_samples; ++sample)
+    {
+        const auto target_length = total_length * sample / (num_samples - 1);
+
+        while (index + 2 < table_length.size() && table_length[index + 1] < target_length)
+        {
+            ++index;
+        }
+
+        const auto span = index / num_subdivisions;
+        const auto u_span = spline.knot_vector[span + degree];
+
+        const auto u_left = table_u[index];
+        const auto u_right = table_u[index + 1];
+        const auto interval_length = table_length[index + 1] - table_length[index];
+
+        // Interpolate linearly in the table, and refine using Newton's method on the arc length
+        auto u = u_left + ((interval_length > 0.0) ? ((target_length - table_length[index]) / interval_length * (u_right - u_left)) : 0.0);
+
+        for (std::size_t i = 0; i < 3 && interval_length > 0.0; ++i)
+        {
+            Eigen::Vector3d position, first_derivative, second_derivative;
+            evaluate_segment(coefficients[span], degree, kernels, u - u_span, position, first_derivative, second_derivative);
+
+            const auto speed = first_derivative.norm();
+
+            if (speed <= 0.0)
+            {
+                break;
+            }
+
+            const auto length = table_length[index] + compute_arc_length(coefficients[span], degree, kernels, u_span, u_left, u);
+
+            u = std::min(std::max(u - (length - target_length) / speed, u_left), u_right);
+        }
+
+        arc_parameters[sample] = u;
+    }
+
+    arc_parameters.back() = spline.knot_vector[num_de_boor_points];
+}
+
+void b_spline::compute_adaptive_parameters(const spline_t& spline, const std::size_t degree,
+    const double tolerance, std::vector<double>& arc_parameters) const
+{
+    const auto num_de_boor_points = get_num_de_boor_points(spline.knot_vector.cbegin(), spline.knot_vector.cend(), degree);
+    const auto num_spans = num_de_boor_points - degree;
+
+    // Bound the second derivative on each span by the norm of the de Boor points of the second derivative
+    // that influence the span, using the convex hull property; linear B-splines are straight on each span
+    std::vector<double> max_second_derivative(num_spans, 0.0);
+
+    if (degree > 1)
+    {
+        const auto first_derivative = derive(spline.de_boor_points, spline.knot_vector.cbegin(), spline.knot_vector.cend(), degree);
+        const auto second_derivative = derive(first_derivative, spline.knot_vector.cbegin() + 1, spline.knot_vector.cend() - 1, degree - 1);
+
+        for (std::size_t span = 0; span < num_spans; ++span)
+        {
+            for (auto j = span; j <= span + degree - 2; ++j)
+            {
+                max_second_derivative[span] = std::max(max_second_derivative[span], second_derivative[j % second_derivative.size()].norm());
+            }
+        }
+    }
+
+    arc_parameters.clear();
+
+    subdivide(spline, degree, tolerance, max_second_derivative, 0, num_spans, arc_parameters);
+
+    arc_parameters.push_back(spline.knot_vector[num_de_boor_points]);
+}
+
+void b_spline::subdivide(const spline_t& spline, const std::size_t degree, const double tolerance, const std::vector<double>& max_second_derivative,
+    const std::size_t first_span, const std::size_t last_span, std::vector<double>& arc_parameters) const
+{
+    // The deviation of the curve from its chord is bounded by (u_end - u_begin)^2 / 8 times the maximum norm of the second derivative;
+    // across knots, this only holds for B-splines with continuous first derivative
+    const auto u_begin = spline.knot_vector[first_span + degree];
+    const auto u_end = spline.knot_vector[last_span + degree];
+
+    const auto max_curvature = *std::max_element(max_second_derivative.begin() + first_span, max_second_derivative.begin() + last_span);
+    const auto deviation = (u_end - u_begin) * (u_end - u_begin) * max_curvature / 8.0;
+
+    if (deviation <= tolerance && (degree > 1 || last_span - first_span == 1))
+    {
+        arc_parameters.push_back(u_begin);
+    }
+    else if (last_span - first_span > 1)
+    {
+        // Split at the middle knot
+        const auto middle_span = first_span + (last_span - first_span) / 2;
+
+        subdivide(spline, degree, tolerance, max_second_derivative, first_span, middle_span, arc_parameters);
+        subdivide(spline, degree, tolerance, max_second_derivative, middle_span, last_span, arc_parameters);
+    }
+    else
+    {
+        // Split the single span into the minimum number of uniform parts satisfying the tolerance
+        const auto num_parts = static_cast<std::size_t>(std::ceil((u_end - u_begin) * std::sqrt(max_curvature / (8.0 * tolerance))));
+
+        for (std::size_t i = 0; i < num_parts; ++i)
+        {
+            arc_parameters.push_back(u_begin + (u_end - u_begin) * i / num_parts);
+        }
+    }
+}
+
+double b_spline::compute_arc_length(const std::vector<Eigen::Vector3d>& coefficients, const std::size_t degree, const kernels_t& kernels,
+    const double u_span, const double u_begin, const double u_end) const
+{
+    // Five-point Gauss-Legendre quadrature of the speed
+    static const std::array<double, 5> nodes{ -0.9061798459386640, -0.5384693101056831, 0.0, 0.5384693101056831, 0.9061798459386640 };
+    static const std::array<double, 5> weights{ 0.2369268850561891, 0.4786286704993665, 0.5688888888888889, 0.4786286704993665, 0.2369268850561891 };
+
+    const auto half_width = 0.5 * (u_end - u_begin);
+    const auto center = 0.5 * (u_begin + u_end);
+
+    Eigen::Vector3d position, first_derivative, second_derivative;
+
+    double length = 0.0;
+
+    for (std::size_t i = 0; i < nodes.size(); ++i)
+    {
+        evaluate_segment(coefficients, degree, kernels, center + half_width * nodes[i] - u_span, position, first_derivative, second_derivative);
+
+        length += weights[i] * first_derivative.norm();
+    }
+
+    return half_width * length;
+}
+
+void b_spline::compute_closest_points(const std::vector<spline_t>& splines, const std::size_t degree, const kernels_t& kernels,
+    vtkPointSet* query_points, vtkPolyData* output) const
+{
+    // Create polynomial segments for all knot spans of all B-splines
+    std::vector<std::size_t> segment_offsets(splines.size() + 1, 0);
+
+    for (std::size_t index = 0; index < splines.size(); ++index)
+    {
+        const auto& knot_vector = splines[index].knot_vector;
+
+        segment_offsets[index + 1] = segment_offsets[index] + (get_num_de_boor_points(knot_vector.cbegin(), knot_vector.cend(), degree) - degree);
+    }
+
+    std::vector<segment_t> segments(segment_offsets.back());
+
+    auto create_segments = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType index = begin; index < end; ++index)
+        {
+            const auto& spline = splines[index];
+            const auto num_de_boor_points = get_num_de_boor_points(spline.knot_vector.cbegin(), spline.knot_vector.cend(), degree);
+
+            for (auto span = degree; span < num_de_boor_points; ++span)
+            {
+                auto& segment = segments[segment_offsets[index] + span - degree];
+
+                segment.spline = static_cast<std::size_t>(index);
+                segment.u_begin = spline.knot_vector[span];
+                segment.u_end = spline.knot_vector[span + 1];
+
+                compute_span_coefficients(spline.de_boor_points, spline.knot_vector.cbegin(), degree, kernels, span, segment.coefficients);
+
+                // By the convex hull property, the segment lies within the bounds of its de Boor points
+                segment.bounds.setEmpty();
+
+                for (auto j = span - degree; j <= span; ++j)
+                {
+                    segment.bounds.extend(spline.de_boor_points[j % spline.de_boor_points.size()]);
+                }
+            }
+        }
+    };
+
+    vtkSMPTools::For(0, static_cast<vtkIdType>(splines.size()), create_segments);
+
+    // Create bounding volume hierarchy over the segments
+    std::vector<node_t> nodes;
+    nodes.reserve(2 * segments.size());
+
+    build_hierarchy(segments, 0, segments.size(), nodes);
+
+    // Find closest point for each query point
+    const auto num_query_points = query_points->GetNumberOfPoints();
+
+    auto output_distance = vtkSmartPointer<vtkFloatArray>::New();
+    output_distance->SetNumberOfComponents(1);
+    output_distance->SetNumberOfTuples(num_query_points);
+    output_distance->SetName("Distance");
+
+    auto output_arc_position = vtkSmartPointer<vtkFloatArray>::New();
+    output_arc_position->SetNumberOfComponents(1);
+    output_arc_position->SetNumberOfTuples(num_query_points);
+    output_arc_position->SetName("Parametric Position");
+
+    auto output_closest_point = vtkSmartPointer<vtkFloatArray>::New();
+    output_closest_point->SetNumberOfComponents(3);
+    output_closest_point->SetNumberOfTuples(num_query_points);
+    output_closest_point->SetName("Closest Point");
+
+    auto output_spline = vtkSmartPointer<vtkIdTypeArray>::New();
+    output_spline->SetNumberOfComponents(1);
+    output_spline->SetNumberOfTuples(num_query_points);
+    output_spline->SetName("B-spline");
+
+    auto* distance_values = output_distance->GetPointer(0);
+    auto* arc_position_values = output_arc_position->GetPointer(0);
+    auto* closest_point_values = output_closest_point->GetPointer(0);
+    auto* spline_values = output_spline->GetPointer(0);
+
+    auto find_closest = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        Eigen::Vector3d point;
+
+        for (vtkIdType index = begin; index < end; ++index)
+        {
+            query_points->GetPoints()->GetPoint(index, point.data());
+
+            const auto closest = compute_closest_point(segments, nodes, degree, kernels, point);
+
+            distance_values[index] = static_cast<float>(closest.distance);
+            arc_position_values[index] = static_cast<float>(closest.arc_parameter);
+            spline_values[index] = static_cast<vtkIdType>(closest.spline);
+
+            for (int c = 0; c < 3; ++c)
+            {
+                closest_point_values[index * 3 + c] = static_cast<float>(closest.position[c]);
+            }
+        }
+    };
+
+    vtkSMPTools::For(0, num_query_points, find_closest);
+
+    // Set output
+    output->SetPoints(query_points->GetPoints());
+    output->GetPointData()->ShallowCopy(query_points->GetPointData());
+    output->GetPointData()->AddArray(output_distance);
+    output->GetPointData()->AddArray(output_arc_position);
+    output->GetPointData()->AddArray(output_closest_point);
+    output->GetPointData()->AddArray(output_spline);
+    output->SetVerts(vertex_cells(num_query_points));
+}
+
+std::size_t b_spline::build_hierarchy(std::vector<segment_t>& segments, const std::size_t begin, const std::size_t end, std::vector<node_t>& nodes) const
+{
+    constexpr std::size_t max_leaf_size = 4;
+
+    const auto index = nodes.size();
+    nodes.emplace_back();
+
+    Eigen::AlignedBox3d bounds;
+
+    for (auto i = begin; i < end; ++i)
+    {
+        bounds.extend(segments[i].bounds);
+    }
+
+    nodes[index].bounds = bounds;
+    nodes[index].begin = begin;
+    nodes[index].end = end;
+    nodes[index].left = nodes[index].right = 0;
+
+    if (end - begin > max_leaf_size)
+    {
+        // Split at the median of the segment centers along the largest extent
+        Eigen::Index axis = 0;
+        bounds.sizes().maxCoeff(&axis);
+
+        const auto middle = begin + (end - begin) / 2;
+
+        std::nth_element(segments.begin() + begin, segments.begin() + middle, segments.begin() + end,
+            [axis](const segment_t& lhs, const segment_t& rhs) { return lhs.bounds.center()[axis] < rhs.bounds.center()[axis]; });
+
+        const auto left = build_hierarchy(segments, begin, middle, nodes);
+        const auto right = build_hierarchy(segments, middle, end, nodes);
+
+        nodes[index].left = left;
+        nodes[index].right = right;
+    }
+
+    return index;
+}
+
+b_spline::closest_t b_spline::compute_closest_point(const std::vector<segment_t>& segments, const std::vector<node_t>& nodes,
+    const std::size_t degree, const kernels_t& kernels, const Eigen::Vector3d& point) const
+{
+    closest_t closest{ 0, 0.0, std::numeric_limits<double>::max(), point };
+
+    if (nodes.empty())
+    {
+        return closest;
+    }
+
+    // Traverse hierarchy depth-first, visiting the nearer child first and skipping nodes farther away than the current result;
+    // the stack size is bounded by the depth of the balanced hierarchy
+    std::array<std::size_t, 128> stack;
+    std::size_t stack_size = 0;
+
+    stack[stack_size++] = 0;
+
+    while (stack_size > 0)
+    {
+        const auto& node = nodes[stack[--stack_size]];
+
+        if (node.bounds.squaredExteriorDistance(point) >= closest.distance * closest.distance)
+        {
+            continue;
+        }
+
+        if (node.left == 0)
+        {
+            for (auto i = node.begin; i < node.end; ++i)
+            {
+                if (segments[i].bounds.squaredExteriorDistance(point) < closest.distance * closest.distance)
+                {
+                    refine_closest_point(segments[i], degree, kernels, point, closest);
+                }
+            }
+        }
+        else
+        {
+            const auto left_distance = nodes[node.left].bounds.squaredExteriorDistance(point);
+            const auto right_distance = nodes[node.right].bounds.squaredExteriorDistance(point);
+
+            const auto near = (left_distance <= right_distance) ? node.left : node.right;
+            const auto far = (left_distance <= right_distance) ? node.right : node.left;
+
+            stack[stack_size++] = far;
+            stack[stack_size++] = near;
+        }
+    }
+
+    return closest;
+}
+
+void b_spline::refine_closest_point(const segment_t& segment, const std::size_t degree, const kernels_t& kernels,
+    const Eigen::Vector3d& point, closest_t& closest) const
+{
+    Eigen::Vector3d position, first_derivative, second_derivative;
+
+    auto squared_distance = [&](const double u)
+    {
+        evaluate_segment(segment.coefficients, degree, kernels, u - segment.u_begin, position, first_derivative, second_derivative);
+
+        return (position - point).squaredNorm();
+    };
+
+    double best_u = segment.u_begin;
+    double best_squared_distance = std::numeric_limits<double>::max();
+
+    // Use Newton's method to find the roots of the derivative of the squared distance, staying within the segment;
+    // as the distance can have multiple local minima per segment, start from uniformly distributed samples
+    const auto num_samples = 2 * degree + 1;
+
+    for (std::size_t sample = 0; sample < num_samples; ++sample)
+    {
+        auto u = segment.u_begin + (segment.u_end - segment.u_begin) * sample / (num_samples - 1);
+
+        for (std::size_t i = 0; i < 10; ++i)
+        {
+            const auto current_squared_distance = squared_distance(u);
+
+            if (current_squared_distance < best_squared_distance)
+            {
+                best_u = u;
+                best_squared_distance = current_squared_distance;
+            }
+
+            const Eigen::Vector3d difference = position - point;
+
+            const auto first = first_derivative.dot(difference);
+            const auto second = second_derivative.dot(difference) + first_derivative.squaredNorm();
+
+            if (second <= 0.0)
+            {
+                break;
+            }
+
+            const auto next_u = std::min(std::max(u - first / second, segment.u_begin), segment.u_end);
+
+            if (next_u == u)
+            {
+                break;
+            }
+
+            u = next_u;
+        }
+    }
+
+    // Set new closest point
+    if (best_squared_distance < closest.distance * closest.distance)
+    {
+        squared_distance(best_u);
+
+        closest.spline = segment.spline;
+        closest.arc_parameter = best_u;
+        closest.distance = std::sqrt(best_squared_distance);
+        closest.position = position;
+    }
+}
+
+Eigen::Vector3d b_spline::compute_point(const std::vector<Eigen::Vector3d>& de_boor_points,
+    std::vector<double>::const_iterator knot_vector, std::vector<double>::const_iterator knot_vector_end,
+    const std::size_t degree, const double arc_parameter) const
+{
+    const auto span = find_span(knot_vector, get_num_de_boor_points(knot_vector, knot_vector_end, degree), degree, arc_parameter);
+
+    // Use de Boor's algorithm on the degree + 1 de Boor points influencing the knot span
+    std::vector<Eigen::Vector3d> points(degree + 1);
+
+    for (std::size_t j = 0; j <= degree; ++j)
+    {
+        points[j] = de_boor_points[(span - degree + j) % de_boor_points.size()];
+    }
+
+    for (std::size_t r = 1; r <= degree; ++r)
+    {
+        for (std::size_t j = degree; j >= r; --j)
+        {
+            const auto left = access_at(knot_vector, span - degree + j);
+            const auto right = access_at(knot_vector, span + 1 + j - r);
+
+            const auto alpha = (right == left) ? 0.0 : ((arc_parameter - left) / (right - left));
+
+            points[j] = (1.0 - alpha) * points[j - 1] + alpha * points[j];
+        }
+    }
+
+    return points[degree];
+}
+
+void b_spline::compute_points(const std::vector<Eigen::Vector3d>& de_boor_points,
+    std::vector<double>::const_iterator knot_vector, std::vector<double>::const_iterator knot_vector_end,
+    const std::size_t degree, const kernels_t& kernels, const std::vector<double>& arc_parameters, std::vector<Eigen::Vector3d>& points,
+    std::vector<Eigen::Vector3d>& first_derivatives, std::vector<Eigen::Vector3d>& second_derivatives) const
+{
+    points.resize(arc_parameters.size());
+    first_derivatives.resize(arc_parameters.size());
+    second_derivatives.resize(arc_parameters.size());
+
+    if (arc_parameters.empty())
+    {
+        return;
+    }
+
+    // Walk through the knot spans, computing the polynomial coefficients only once per span
+    const auto num_de_boor_points = get_num_de_boor_points(knot_vector, knot_vector_end, degree);
+
+    auto span = find_span(knot_vector, num_de_boor_points, degree, arc_parameters.front());
+
+    std::vector<Eigen::Vector3d> coefficients;
+    compute_span_coefficients(de_boor_points, knot_vector, degree, kernels, span, coefficients);
+
+    for (std::size_t i = 0; i < arc_parameters.size(); ++i)
+    {
+        const auto u = arc_parameters[i];
+
+        if (span + 1 < num_de_boor_points && u >= access_at(knot_vector, span + 1))
+        {
+            span = find_span(knot_vector, num_de_boor_points, degree, u);
+            compute_span_coefficients(de_boor_points, knot_vector, degree, kernels, span, coefficients);
+        }
+
+        Eigen::Vector3d position, first_derivative, second_derivative;
+
+        evaluate_segment(coefficients, degree, kernels, u - access_at(knot_vector, span), position, first_derivative, second_derivative);
+
+        points[i] = position;
+        first_derivatives[i] = first_derivative;
+        second_derivatives[i] = second_derivative;
+    }
+}
+
+void b_spline::evaluate_segment(const std::vector<Eigen::Vector3d>& coefficients, const std::size_t degree, const kernels_t& kernels,
+    const double s, Eigen::Vector3d& position, Eigen::Vector3d& first_derivative, Eigen::Vector3d& second_derivative) const
+{
+    kernels.evaluate_segment(coefficients.data(), degree, s, position, first_derivative, second_derivative);
+}
+
+void b_spline::compute_span_coefficients(const std::vector<Eigen::Vector3d>& de_boor_points,
+    std::vector<double>::const_iterator knot_vector, const std::size_t degree, const kernels_t& kernels, const std::size_t span,
+    std::vector<Eigen::Vector3d>& coefficients) const
+{
+    coefficients.resize(degree + 1);
+
+    kernels.compute_span_coefficients(de_boor_points.data(), de_boor_points.size(), &*knot_vector, degree, span, coefficients.data());
+}
+
+b_spline::kernels_t b_spline::select_kernels(const std::size_t degree)
+{
+    switch (degree)
+    {
+    case 1:
+        return kernels_t{ &evaluate_segment_kernel<1>, &compute_span_coefficients_kernel<1> };
+    case 2:
+        return kernels_t{ &evaluate_segment_kernel<2>, &compute_span_coefficients_kernel<2> };
+    case 3:
+        return kernels_t{ &evaluate_segment_kernel<3>, &compute_span_coefficients_kernel<3> };
+    case 4:
+        return kernels_t{ &evaluate_segment_kernel<4>, &compute_span_coefficients_kernel<4> };
+    case 5:
+        return kernels_t{ &evaluate_segment_kernel<5>, &compute_span_coefficients_kernel<5> };
+    default:
+        return kernels_t{ &evaluate_segment_kernel<0>, &compute_span_coefficients_kernel<0> };
+    }
+}
+
+template <std::size_t fixed_degree>
+void b_spline::evaluate_segment_kernel(const Eigen::Vector3d* coefficients, const std::size_t degree, const double s,
+    Eigen::Vector3d& position, Eigen::Vector3d& first_derivative, Eigen::Vector3d& second_derivative)
+{
+    const auto p = (fixed_degree > 0) ? fixed_degree : degree;
+
+    // Evaluate polynomial and its derivatives with Horner's scheme
+    position = coefficients[p];
+    first_derivative.setZero();
+    second_derivative.setZero();
+
+    for (std::size_t j = p; j-- > 0;)
+    {
+        second_derivative = second_derivative * s + 2.0 * first_derivative;
+        first_derivative = first_derivative * s + position;
+        position = position * s + coefficients[j];
+    }
+}
+
+template <std::size_t fixed_degree>
+void b_spline::compute_span_coefficients_kernel(const Eigen::Vector3d* de_boor_points, const std::size_t num_de_boor_points,
+    const double* knot_vector, const std::size_t degree, const std::size_t span, Eigen::Vector3d* coefficients)
+{
+    const auto p = static_cast<int>((fixed_degree > 0) ? fixed_degree : degree);
+    const auto n = static_cast<std::size_t>(p + 1);
+
+    // Use buffers on the stack for fixed degrees, and allocate them otherwise
+    std::array<double, 2 * (fixed_degree + 1) * (fixed_degree + 3)> fixed_buffer;
+    std::vector<double> dynamic_buffer((fixed_degree > 0) ? 0 : (2 * n * (n + 2)));
+
+    auto* ndu = (fixed_degree > 0) ? fixed_buffer.data() : dynamic_buffer.data();
+    auto* derivatives = ndu + n * n;
+    auto* a = derivatives + n * n;
+    auto* left = a + 2 * n;
+    auto* right = left + n;
+
+    // Compute the non-zero basis functions and all their derivatives at the beginning of the span,
+    // following algorithm A2.3 in "The NURBS Book" by Piegl and Tiller
+    const auto u = knot_vector[span];
+
+    ndu[0] = 1.0;
+
+    for (int j = 1; j <= p; ++j)
+    {
+        left[j] = u - knot_vector[span + 1 - j];
+        right[j] = knot_vector[span + j] - u;
+
+        double saved = 0.0;
+
+        for (int r = 0; r < j; ++r)
+        {
+            ndu[j * n + r] = right[r + 1] + left[j - r];
+
+            const auto temp = ndu[r * n + j - 1] / ndu[j * n + r];
+
+            ndu[r * n + j] = saved + right[r + 1] * temp;
+            saved = left[j - r] * temp;
+        }
+
+        ndu[j * n + j] = saved;
+    }
+
+    for (int j = 0; j <= p; ++j)
+    {
+        derivatives[j] = ndu[j * n + p];
+    }
+
+    for (int r = 0; r <= p; ++r)
+    {
+        int s1 = 0;
+        int s2 = 1;
+
+        a[0] = 1.0;
+
+        for (int k = 1; k <= p; ++k)
+        {
+            double d = 0.0;
+
+            const auto rk = r - k;
+            const auto pk = p - k;
+
+            if (r >= k)
+            {
+                a[s2 * n] = a[s1 * n] / ndu[(pk + 1) * n + rk];
+                d = a[s2 * n] * ndu[rk * n + pk];
+            }
+
+            const auto j1 = (rk >= -1) ? 1 : -rk;
+            const auto j2 = (r - 1 <= pk) ? (k - 1) : (p - r);
+
+            for (auto j = j1; j <= j2; ++j)
+            {
+                a[s2 * n + j] = (a[s1 * n + j] - a[s1 * n + j - 1]) / ndu[(pk + 1) * n + rk + j];
+                d += a[s2 * n + j] * ndu[(rk + j) * n + pk];
+            }
+
+            if (r <= pk)
+            {
+                a[s2 * n + k] = -a[s1 * n + k - 1] / ndu[(pk + 1) * n + r];
+                d += a[s2 * n + k] * ndu[r * n + pk];
+            }
+
+            derivatives[k * n + r] = d;
+            std::swap(s1, s2);
+        }
+    }
+
+    // The coefficients of the polynomial in (u - u_span) are the derivatives divided by their factorial,
+    // which cancels with the factors p! / (p - k)! of the basis function derivatives to p over k;
+    // the de Boor points wrap around for periodic B-splines
+    double factor = 1.0;
+
+    for (int k = 0; k <= p; ++k)
+    {
+        coefficients[k].setZero();
+
+        for (int j = 0; j <= p; ++j)
+        {
+            coefficients[k] += factor * derivatives[k * n + j] * de_boor_points[(span - p + j) % num_de_boor_points];
+        }
+
+        factor *= static_cast<double>(p - k) / (k + 1);
+    }
+}
+
+std::size_t b_spline::find_span(std::vector<double>::const_iterator knot_vector, const std::size_t num_de_boor_points,
+    const std::size_t degree, const double arc_parameter) const
+{
+    // Find the last knot not larger than the arc parameter, restricted to the valid spans [u_degree, u_n-1]
+    const auto first = knot_vector + degree + 1;
+    const auto last = knot_vector + num_de_boor_points;
+
+    return static_cast<std::size_t>(std::upper_bound(first, last, arc_parameter) - knot_vector) - 1;
+}
+
+std::size_t b_spline::get_num_de_boor_points(std::vector<double>::const_iterator knot_vector,
+    std::vector<double>::const_iterator knot_vector_end, const std::size_t degree) const
+{
+    return static_cast<std::size_t>(knot_vector_end - knot_vector) - degree - 1;
+}
+
+std::vector<Eigen::Vector3d> b_spline::derive(const std::vector<Eigen::Vector3d>& de_boor_points,
+    std::vector<double>::const_iterator knot_vector, std::vector<double>::const_iterator knot_vector_end, const std::size_t degree) const
+{
+    // The derivative of a periodic B-spline is periodic with the same number of distinct de Boor points
+    const auto num_de_boor_points = de_boor_points.size();
+
+    std::vector<Eigen::Vector3d> derived_de_boor_points(std::min(num_de_boor_points, get_num_de_boor_points(knot_vector, knot_vector_end, degree) - 1));
 
     for (std::size_t index = 0; index < derived_de_boor_points.size(); ++index)
     {
         derived_de_boor_points[index] = static_cast<double>(degree / (access_at(knot_vector, index + degree + 1) - access_at(knot_vector, index + 1)))
-            * (de_boor_points[index + 1] - de_boor_points[index]);
+            * (de_boor_points[(index + 1) % num_de_boor_points] - de_boor_points[index]);
     }
 
     return derived_de_boor_points;
@@ -2,6 +2,8 @@
 
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
+#include "vtkPointSet.h"
+#include "vtkPolyData.h"
 #include "vtkPolyDataAlgorithm.h"
 
 #include "Eigen/Dense"
@@ -28,6 +30,21 @@ public:
     vtkGetMacro(HitEndpoints, int);
     vtkSetMacro(HitEndpoints, int);
 
+    vtkGetMacro(Periodic, int);
+    vtkSetMacro(Periodic, int);
+
+    vtkGetMacro(Sampling, int);
+    vtkSetMacro(Sampling, int);
+
+    vtkGetMacro(Tolerance, double);
+    vtkSetMacro(Tolerance, double);
+
+    vtkGetMacro(Fitting, int);
+    vtkSetMacro(Fitting, int);
+
+    vtkGetMacro(NumberOfDeBoorPoints, int);
+    vtkSetMacro(NumberOfDeBoorPoints, int);
+
 protected:
     b_spline();
 
@@ -39,14 +56,141 @@ private:
     b_spline(const b_spline&);
     void operator=(const b_spline&);
 
+    /// Kernels for polynomial segments, specialized for low degrees
+    struct kernels_t
+    {
+        void (*evaluate_segment)(const Eigen::Vector3d* coefficients, std::size_t degree, double s,
+            Eigen::Vector3d& position, Eigen::Vector3d& first_derivative, Eigen::Vector3d& second_derivative);
+
+        void (*compute_span_coefficients)(const Eigen::Vector3d* de_boor_points, std::size_t num_de_boor_points,
+            const double* knot_vector, std::size_t degree, std::size_t span, Eigen::Vector3d* coefficients);
+    };
+
+    /// Select kernels specialized for degrees 1 to 5, or the generic kernels otherwise
+    static kernels_t select_kernels(std::size_t degree);
+
+    /// B-Spline, defined by its de Boor points and knot vector; for periodic B-Splines, the knot vector
+    /// is longer by the degree, and the de Boor points are accessed with wrap-around instead of being repeated
+    struct spline_t
+    {
+        std::vector<Eigen::Vector3d> de_boor_points;
+        std::vector<double> knot_vector;
+    };
+
+    /// Fit a B-Spline with the given number of de Boor points to the points, using least squares approximation
+    bool fit_spline(const std::vector<Eigen::Vector3d>& points, std::size_t num_de_boor_points,
+        std::size_t degree, bool hit_endpoints, bool periodic, spline_t& spline) const;
+
+    /// Fit a periodic B-Spline with the given number of de Boor points to the points of a closed line, using least squares approximation
+    bool fit_periodic_spline(const std::vector<Eigen::Vector3d>& points, std::size_t num_de_boor_points,
+        std::size_t degree, spline_t& spline) const;
+
+    /// Compute the non-zero basis functions on a knot span
+    void compute_basis_functions(std::vector<double>::const_iterator knot_vector_begin, std::size_t degree,
+        std::size_t span, double u, double* basis) const;
+
+    /// Solve a symmetric positive definite banded system of equations in place, using the Cholesky decomposition
+    bool solve_banded(std::vector<double>& matrix, std::size_t size, std::size_t half_bandwidth,
+        std::vector<Eigen::Vector3d>& right_hand_side) const;
+
+    /// Create knot vector, optionally with multiplicity at the ends to hit the first and last de Boor point,
+    /// or uniform and extended by the degree for wrap-around of the de Boor points of periodic B-Splines
+    std::vector<double> create_knot_vector(std::size_t num_de_boor_points, std::size_t degree, bool hit_endpoints, bool periodic) const;
+
+    /// Polynomial segment of a B-Spline on a single knot span, with the bounds of its de Boor points
+    struct segment_t
+    {
+        std::size_t spline;
+        double u_begin;
+        double u_end;
+        std::vector<Eigen::Vector3d> coefficients;
+        Eigen::AlignedBox3d bounds;
+    };
+
+    /// Node of the bounding volume hierarchy over the segments, with children for inner nodes and a range of segments for leaves
+    struct node_t
+    {
+        Eigen::AlignedBox3d bounds;
+        std::size_t begin, end;
+        std::size_t left, right;
+    };
+
+    /// Closest point on the B-splines
+    struct closest_t
+    {
+        std::size_t spline;
+        double arc_parameter;
+        double distance;
+        Eigen::Vector3d position;
+    };
+
+    /// Compute arc parameters for samples at equal arc length along the B-Spline, using a cumulative arc length table
+    void compute_arc_length_parameters(const spline_t& spline, std::size_t degree, const kernels_t& kernels,
+        std::size_t num_samples, std::vector<double>& arc_parameters) const;
+
+    /// Compute arc parameters for samples with a bounded deviation of the resulting polyline from the B-Spline
+    void compute_adaptive_parameters(const spline_t& spline, std::size_t degree, double tolerance, std::vector<double>& arc_parameters) const;
+
+    /// Recursively subdivide a range of knot spans until the deviation from the chord is within the tolerance, adding the start of each part
+    void subdivide(const spline_t& spline, std::size_t degree, double tolerance, const std::vector<double>& max_second_derivative,
+        std::size_t first_span, std::size_t last_span, std::vector<double>& arc_parameters) const;
+
+    /// Compute the arc length of a polynomial segment between two arc parameters, using Gauss-Legendre quadrature
+    double compute_arc_length(const std::vector<Eigen::Vector3d>& coefficients, std::size_t degree, const kernels_t& kernels,
+        double u_span, double u_begin, double u_end) const;
+
+    /// Compute the closest points on the B-Splines for all query points, and store them as point data of the output
+    void compute_closest_points(const std::vector<spline_t>& splines, std::size_t degree, const kernels_t& kernels,
+        vtkPointSet* query_points, vtkPolyData* output) const;
+
+    /// Recursively build bounding volume hierarchy, reordering the segments, and return the index of the created node
+    std::size_t build_hierarchy(std::vector<segment_t>& segments, std::size_t begin, std::size_t end, std::vector<node_t>& nodes) const;
+
+    /// Compute the point on the B-Splines closest to the given point, pruning segments using the bounding volume hierarchy
+    closest_t compute_closest_point(const std::vector<segment_t>& segments, const std::vector<node_t>& nodes,
+        std::size_t degree, const kernels_t& kernels, const Eigen::Vector3d& point) const;
+
+    /// Find the closest point on a segment using Newton's method, and update the closest point if it is closer
+    void refine_closest_point(const segment_t& segment, std::size_t degree, const kernels_t& kernels,
+        const Eigen::Vector3d& point, closest_t& closest) const;
+
     /// Compute point on the B-Spline
     Eigen::Vector3d compute_point(const std::vector<Eigen::Vector3d>& de_boor_points,
         std::vector<double>::const_iterator knot_vector_begin, std::vector<double>::const_iterator knot_vector_end,
         std::size_t degree, double arc_parameter) const;
 
-    /// B-Spline basis function
-    double basis_function(std::vector<double>::const_iterator knot_vector_begin, std::vector<double>::const_iterator knot_vector_end,
-        std::size_t de_boor_index, std::size_t degree, double u) const;
+    /// Compute points and first and second derivatives on the B-Spline at ascending arc parameters, walking through the knot spans
+    void compute_points(const std::vector<Eigen::Vector3d>& de_boor_points,
+        std::vector<double>::const_iterator knot_vector_begin, std::vector<double>::const_iterator knot_vector_end,
+        std::size_t degree, const kernels_t& kernels, const std::vector<double>& arc_parameters, std::vector<Eigen::Vector3d>& points,
+        std::vector<Eigen::Vector3d>& first_derivatives, std::vector<Eigen::Vector3d>& second_derivatives) const;
+
+    /// Evaluate position, first and second derivative of a polynomial segment, relative to the beginning of the segment
+    void evaluate_segment(const std::vector<Eigen::Vector3d>& coefficients, std::size_t degree, const kernels_t& kernels, double s,
+        Eigen::Vector3d& position, Eigen::Vector3d& first_derivative, Eigen::Vector3d& second_derivative) const;
+
+    /// Compute the coefficients of the polynomial segment of the B-Spline on a knot span, relative to the beginning of the span
+    void compute_span_coefficients(const std::vector<Eigen::Vector3d>& de_boor_points,
+        std::vector<double>::const_iterator knot_vector_begin, std::size_t degree, const kernels_t& kernels, std::size_t span,
+        std::vector<Eigen::Vector3d>& coefficients) const;
+
+    /// Evaluate polynomial segment, for a fixed degree if larger than zero, or for the given degree otherwise
+    template <std::size_t fixed_degree>
+    static void evaluate_segment_kernel(const Eigen::Vector3d* coefficients, std::size_t degree, double s,
+        Eigen::Vector3d& position, Eigen::Vector3d& first_derivative, Eigen::Vector3d& second_derivative);
+
+    /// Compute coefficients of a polynomial segment, for a fixed degree if larger than zero, or for the given degree otherwise
+    template <std::size_t fixed_degree>
+    static void compute_span_coefficients_kernel(const Eigen::Vector3d* de_boor_points, std::size_t num_de_boor_points,
+        const double* knot_vector, std::size_t degree, std::size_t span, Eigen::Vector3d* coefficients);
+
+    /// Get the number of de Boor points from the size of the knot vector, counting wrapped-around de Boor points of periodic B-Splines
+    std::size_t get_num_de_boor_points(std::vector<double>::const_iterator knot_vector_begin,
+        std::vector<double>::const_iterator knot_vector_end, std::size_t degree) const;
+
+    /// Find the knot span containing the arc parameter, clamped to the valid range of the B-Spline
+    std::size_t find_span(std::vector<double>::const_iterator knot_vector_begin, std::size_t num_de_boor_points,
+        std::size_t degree, double arc_parameter) const;
 
     /// Create new control points representing the derivative of the B-Spline as new B-Spline
     std::vector<Eigen::Vector3d> derive(const std::vector<Eigen::Vector3d>& de_boor_points,
@@ -60,6 +204,21 @@ private:
 
     /// Hit endpoints through multiplicity in the knot vector
     int HitEndpoints;
+
+    /// Create closed B-Splines using a periodic knot vector
+    int Periodic;
+
+    /// Sampling method: 0 uniform in the arc parameter, 1 uniform in arc length, 2 adaptive
+    int Sampling;
+
+    /// Maximum deviation of the output polyline from the B-Spline for adaptive sampling
+    double Tolerance;
+
+    /// Fitting method: 0 use the input points as de Boor points, 1 least squares approximation
+    int Fitting;
+
+    /// Number of de Boor points for least squares approximation
+    int NumberOfDeBoorPoints;
 };
 
 /// Convert to string
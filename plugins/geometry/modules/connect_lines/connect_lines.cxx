@@ -2,19 +2,22 @@
 
 #include "vtkCellArray.h"
 #include "vtkDataObject.h"
-#include "vtkIdList.h"
-#include "vtkIdTypeArray.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkObjectFactory.h"
 #include "vtkPointData.h"
 #include "vtkPoints.h"
 #include "vtkPolyData.h"
+#include "vtkSMPTools.h"
 #include "vtkSmartPointer.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
-#include <iostream>
-#include <list>
+#include "common/line_cells.h"
+
+#include <algorithm>
+#include <numeric>
+#include <utility>
+#include <vector>
 
 vtkStandardNewMacro(connect_lines);
 
@@ -46,100 +49,152 @@ int connect_lines::RequestData(vtkInformation*, vtkInformationVector** input_vec
     auto* in_info = input_vector[0]->GetInformationObject(0);
     auto* input = vtkPolyData::SafeDownCast(in_info->Get(vtkDataObject::DATA_OBJECT()));
 
-    std::list<std::list<vtkIdType>> lines(input->GetLines()->GetNumberOfCells());
+    const line_view lines(input->GetLines());
+    const auto num_lines = lines.size();
+    const auto num_points = input->GetNumberOfPoints();
+
+    auto front = [&lines](const vtkIdType line_index) { return *lines.begin(line_index); };
+    auto back = [&lines](const vtkIdType line_index) { return *(lines.end(line_index) - 1); };
 
-    input->GetLines()->InitTraversal();
-    for (auto& line : lines)
+    // Create adjacency from endpoints to lines in CSR layout
+    std::vector<vtkIdType> adjacency_offsets(num_points + 1, 0);
+
+    for (vtkIdType line_index = 0; line_index < num_lines; ++line_index)
     {
-        auto point_ids = vtkSmartPointer<vtkIdList>::New();
-        input->GetLines()->GetNextCell(point_ids);
+        if (lines.size(line_index) > 0)
+        {
+            ++adjacency_offsets[front(line_index) + 1];
+            ++adjacency_offsets[back(line_index) + 1];
+        }
+    }
+
+    std::partial_sum(adjacency_offsets.begin(), adjacency_offsets.end(), adjacency_offsets.begin());
+
+    std::vector<vtkIdType> adjacency(adjacency_offsets[num_points]);
+    std::vector<vtkIdType> adjacency_cursors(adjacency_offsets.begin(), adjacency_offsets.end() - 1);
 
-        for (std::size_t p = 0; p < static_cast<std::size_t>(point_ids->GetNumberOfIds()); ++p)
+    for (vtkIdType line_index = 0; line_index < num_lines; ++line_index)
+    {
+        if (lines.size(line_index) > 0)
         {
-            line.push_back(point_ids->GetId(p));
+            adjacency[adjacency_cursors[front(line_index)]++] = line_index;
+            adjacency[adjacency_cursors[back(line_index)]++] = line_index;
         }
     }
 
-    // Create polylines
-    std::list<std::list<vtkIdType>> polylines;
+    std::copy(adjacency_offsets.begin(), adjacency_offsets.end() - 1, adjacency_cursors.begin());
 
-    std::size_t num_indices = 0;
+    // Create polylines by chaining lines that share an endpoint, given as sequence of (possibly reversed) lines
+    std::vector<bool> visited(num_lines, false);
 
-    while (!lines.empty())
+    auto next_line = [&](const vtkIdType point) -> vtkIdType
     {
-        polylines.push_back(lines.front());
-        lines.pop_front();
+        auto& cursor = adjacency_cursors[point];
+
+        while (cursor < adjacency_offsets[point + 1] && visited[adjacency[cursor]])
+        {
+            ++cursor;
+        }
 
-        bool change = true;
+        return (cursor < adjacency_offsets[point + 1]) ? adjacency[cursor] : -1;
+    };
 
-        while (change)
+    std::vector<std::pair<vtkIdType, bool>> chains;
+    std::vector<vtkIdType> chain_offsets(1, 0);
+
+    chains.reserve(num_lines);
+
+    std::vector<std::pair<vtkIdType, bool>> front_chain;
+
+    for (vtkIdType line_index = 0; line_index < num_lines; ++line_index)
+    {
+        if (visited[line_index] || lines.size(line_index) == 0)
         {
-            change = false;
+            continue;
+        }
 
-            for (auto it = lines.begin(); it != lines.end();)
-            {
-                if (polylines.back().front() == it->front())
-                {
-                    polylines.back().push_front(it->back());
-                    lines.erase(it++);
+        visited[line_index] = true;
 
-                    change = true;
-                }
-                else if (polylines.back().front() == it->back())
-                {
-                    polylines.back().push_front(it->front());
-                    lines.erase(it++);
+        // Extend at the front, prepending lines that end in the current point
+        front_chain.clear();
 
-                    change = true;
-                }
-                else if (polylines.back().back() == it->front())
-                {
-                    polylines.back().push_back(it->back());
-                    lines.erase(it++);
+        for (auto point = front(line_index), next = next_line(point); next != -1; next = next_line(point))
+        {
+            visited[next] = true;
 
-                    change = true;
-                }
-                else if (polylines.back().back() == it->back())
-                {
-                    polylines.back().push_back(it->front());
-                    lines.erase(it++);
+            const auto reversed = back(next) != point;
+            front_chain.push_back(std::make_pair(next, reversed));
 
-                    change = true;
-                }
-                else
-                {
-                    ++it;
-                }
-            }
+            point = reversed ? back(next) : front(next);
         }
 
-        num_indices += polylines.back().size();
-    }
+        chains.insert(chains.end(), front_chain.rbegin(), front_chain.rend());
+        chains.push_back(std::make_pair(line_index, false));
 
-    // Create output
-    auto* out_info = output_vector->GetInformationObject(0);
-    auto* output = vtkPolyData::SafeDownCast(out_info->Get(vtkDataObject::DATA_OBJECT()));
+        // Extend at the back, appending lines that start in the current point
+        for (auto point = back(line_index), next = next_line(point); next != -1; next = next_line(point))
+        {
+            visited[next] = true;
 
-    output->SetPoints(input->GetPoints());
+            const auto reversed = front(next) != point;
+            chains.push_back(std::make_pair(next, reversed));
+
+            point = reversed ? front(next) : back(next);
+        }
 
-    auto cell_indices = vtkSmartPointer<vtkIdTypeArray>::New();
-    cell_indices->SetNumberOfComponents(1);
-    cell_indices->Allocate(polylines.size() + num_indices);
+        chain_offsets.push_back(static_cast<vtkIdType>(chains.size()));
+    }
+
+    const auto num_polylines = static_cast<vtkIdType>(chain_offsets.size()) - 1;
 
-    for (const auto& line : polylines)
+    // Create polylines, where the shared point of subsequent lines is only stored once
+    line_builder polylines(num_polylines);
+
+    for (vtkIdType polyline = 0; polyline < num_polylines; ++polyline)
     {
-        cell_indices->InsertNextValue(line.size());
+        vtkIdType size = 1;
 
-        for (const auto& index : line)
+        for (auto chain_index = chain_offsets[polyline]; chain_index < chain_offsets[polyline + 1]; ++chain_index)
         {
-            cell_indices->InsertNextValue(index);
+            size += lines.size(chains[chain_index].first) - 1;
         }
+
+        polylines.set_size(polyline, size);
     }
 
-    auto cells = vtkSmartPointer<vtkCellArray>::New();
-    cells->SetCells(polylines.size(), cell_indices);
+    polylines.allocate();
 
-    output->SetLines(cells);
+    auto write_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType polyline = begin; polyline < end; ++polyline)
+        {
+            auto* output_line = polylines.begin(polyline);
+
+            for (auto chain_index = chain_offsets[polyline]; chain_index < chain_offsets[polyline + 1]; ++chain_index)
+            {
+                const auto line_index = chains[chain_index].first;
+                const auto skip = (chain_index != chain_offsets[polyline]) ? 1 : 0;
+
+                if (chains[chain_index].second)
+                {
+                    output_line = std::reverse_copy(lines.begin(line_index), lines.end(line_index) - skip, output_line);
+                }
+                else
+                {
+                    output_line = std::copy(lines.begin(line_index) + skip, lines.end(line_index), output_line);
+                }
+            }
+        }
+    };
+
+    vtkSMPTools::For(0, num_polylines, write_range);
+
+    // Create output
+    auto* out_info = output_vector->GetInformationObject(0);
+    auto* output = vtkPolyData::SafeDownCast(out_info->Get(vtkDataObject::DATA_OBJECT()));
+
+    output->SetPoints(input->GetPoints());
+    output->SetLines(polylines.build());
     output->GetPointData()->ShallowCopy(input->GetPointData());
 
     return 1;
@@ -1,8 +1,8 @@
 #include "connect_points.h"
 
 #include "vtkCellArray.h"
+#include "vtkDataArray.h"
 #include "vtkDataObject.h"
-#include "vtkIdTypeArray.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkObjectFactory.h"
@@ -10,9 +10,24 @@
 #include "vtkPoints.h"
 #include "vtkPointSet.h"
 #include "vtkPolyData.h"
+#include "vtkSMPThreadLocal.h"
+#include "vtkSMPTools.h"
 #include "vtkSmartPointer.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
+#include "common/iota_cells.h"
+#include "common/line_cells.h"
+#include "common/radix_sort.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <numeric>
+#include <type_traits>
+#include <vector>
+
 vtkStandardNewMacro(connect_points);
 
 connect_points::connect_points()
@@ -50,22 +65,225 @@ int connect_points::RequestData(vtkInformation*, vtkInformationVector** input_ve
     output->SetPoints(input->GetPoints());
     output->GetPointData()->ShallowCopy(input->GetPointData());
 
+    const auto num_points = input->GetNumberOfPoints();
+
+    // Without sorting and grouping, all points are connected in storage order, using shared arrays of consecutive indices
+    if (!this->SortByKey && !this->GroupByArray)
+    {
+        output->SetLines(polyline_cell(num_points));
+
+        return 1;
+    }
+
+    // Sort points by key and group, using a stable sort such that the storage order is kept for equal keys
+    std::vector<vtkIdType> order(num_points);
+    std::iota(order.begin(), order.end(), 0);
+
+    std::vector<std::uint64_t> group_keys;
+
+    if (this->SortByKey)
+    {
+        std::vector<std::uint64_t> keys;
+        int num_bits = 0;
+
+        if (!compute_keys(this->GetInputArrayToProcess(1, &input_vector[0]), num_points, keys, num_bits))
+        {
+            std::cerr << "Cannot sort points: Key array must be a scalar point data array." << std::endl;
+            return 0;
+        }
+
+        radix_sort(keys, order, num_bits);
+    }
+
+    if (this->GroupByArray)
+    {
+        std::vector<std::uint64_t> keys;
+        int num_bits = 0;
+
+        if (!compute_keys(this->GetInputArrayToProcess(0, &input_vector[0]), num_points, keys, num_bits))
+        {
+            std::cerr << "Cannot group points: Group array must be a scalar point data array." << std::endl;
+            return 0;
+        }
+
+        // Permute group keys according to the current order, such that sorting them keeps the order within groups
+        group_keys.resize(num_points);
+
+        auto permute = [&](const vtkIdType begin, const vtkIdType end)
+        {
+            for (vtkIdType index = begin; index < end; ++index)
+            {
+                group_keys[index] = keys[order[index]];
+            }
+        };
+
+        vtkSMPTools::For(0, num_points, permute);
+
+        radix_sort(group_keys, order, num_bits);
+    }
+
+    // Find groups, each resulting in one polyline
+    std::vector<vtkIdType> group_offsets(1, 0);
+
+    if (this->GroupByArray)
+    {
+        for (vtkIdType index = 1; index < num_points; ++index)
+        {
+            if (group_keys[index] != group_keys[index - 1])
+            {
+                group_offsets.push_back(index);
+            }
+        }
+    }
+
+    group_offsets.push_back(num_points);
+
     // Create cells
-    auto cell_indices = vtkSmartPointer<vtkIdTypeArray>::New();
-    cell_indices->SetNumberOfComponents(1);
-    cell_indices->Allocate(input->GetNumberOfPoints() + 1);
+    const auto num_groups = static_cast<vtkIdType>(group_offsets.size()) - 1;
 
-    cell_indices->InsertNextValue(input->GetNumberOfPoints());
+    line_builder lines(num_groups);
 
-    for (vtkIdType index = 0; index < input->GetNumberOfPoints(); ++index)
+    for (vtkIdType group = 0; group < num_groups; ++group)
     {
-        cell_indices->InsertNextValue(index);
+        lines.set_size(group, group_offsets[group + 1] - group_offsets[group]);
     }
 
-    auto cells = vtkSmartPointer<vtkCellArray>::New();
-    cells->SetCells(1, cell_indices);
+    lines.allocate();
+
+    auto write_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType group = begin; group < end; ++group)
+        {
+            std::copy(order.begin() + group_offsets[group], order.begin() + group_offsets[group + 1], lines.begin(group));
+        }
+    };
+
+    vtkSMPTools::For(0, num_groups, write_range);
 
-    output->SetLines(cells);
+    output->SetLines(lines.build());
 
     return 1;
 }
+
+bool connect_points::compute_keys(vtkDataArray* array, const vtkIdType num_points, std::vector<std::uint64_t>& keys, int& num_bits) const
+{
+    if (array == nullptr || array->GetNumberOfTuples() != num_points || array->GetNumberOfComponents() != 1)
+    {
+        return false;
+    }
+
+    // Convert values to unsigned integers with the same order
+    keys.resize(num_points);
+
+    if (array->HasStandardMemoryLayout() && array->GetDataType() != VTK_BIT)
+    {
+        switch (array->GetDataType())
+        {
+            vtkTemplateMacro(compute_keys(static_cast<const VTK_TT*>(array->GetVoidPointer(0)), keys));
+        }
+    }
+    else
+    {
+        for (vtkIdType index = 0; index < num_points; ++index)
+        {
+            keys[index] = to_key(array->GetComponent(index, 0));
+        }
+    }
+
+    // Subtract the minimum key, to only sort the necessary number of bits
+    struct range_t
+    {
+        std::uint64_t min = std::numeric_limits<std::uint64_t>::max();
+        std::uint64_t max = 0;
+    };
+
+    vtkSMPThreadLocal<range_t> local_ranges;
+
+    auto compute_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        auto& range = local_ranges.Local();
+
+        for (vtkIdType index = begin; index < end; ++index)
+        {
+            range.min = std::min(range.min, keys[index]);
+            range.max = std::max(range.max, keys[index]);
+        }
+    };
+
+    vtkSMPTools::For(0, num_points, compute_range);
+
+    range_t range;
+
+    for (const auto& thread_range : local_ranges)
+    {
+        range.min = std::min(range.min, thread_range.min);
+        range.max = std::max(range.max, thread_range.max);
+    }
+
+    num_bits = 0;
+
+    if (num_points > 0)
+    {
+        auto shift = [&keys, &range](const vtkIdType begin, const vtkIdType end)
+        {
+            for (vtkIdType index = begin; index < end; ++index)
+            {
+                keys[index] -= range.min;
+            }
+        };
+
+        vtkSMPTools::For(0, num_points, shift);
+
+        for (auto difference = range.max - range.min; difference != 0; difference >>= 1)
+        {
+            ++num_bits;
+        }
+    }
+
+    return true;
+}
+
+template <typename value_t>
+void connect_points::compute_keys(const value_t* values, std::vector<std::uint64_t>& keys)
+{
+    auto convert = [&values, &keys](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType index = begin; index < end; ++index)
+        {
+            keys[index] = to_key(values[index]);
+        }
+    };
+
+    vtkSMPTools::For(0, static_cast<vtkIdType>(keys.size()), convert);
+}
+
+template <typename value_t>
+std::uint64_t connect_points::to_key(const value_t value)
+{
+    return to_key(value, std::is_floating_point<value_t>(), std::is_signed<value_t>());
+}
+
+template <typename value_t>
+std::uint64_t connect_points::to_key(const value_t value, std::true_type, std::true_type)
+{
+    // Flip all bits of negative numbers, and only the sign bit of positive numbers
+    const auto double_value = static_cast<double>(value);
+
+    std::uint64_t bits;
+    std::memcpy(&bits, &double_value, sizeof(double));
+
+    return (bits & (std::uint64_t(1) << 63)) ? ~bits : (bits | (std::uint64_t(1) << 63));
+}
+
+template <typename value_t>
+std::uint64_t connect_points::to_key(const value_t value, std::false_type, std::true_type)
+{
+    // Flip the sign bit, such that negative numbers come first
+    return static_cast<std::uint64_t>(static_cast<std::int64_t>(value)) ^ (std::uint64_t(1) << 63);
+}
+
+template <typename value_t>
+std::uint64_t connect_points::to_key(const value_t value, std::false_type, std::false_type)
+{
+    return static_cast<std::uint64_t>(value);
+}
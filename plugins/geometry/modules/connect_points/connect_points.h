@@ -2,14 +2,25 @@
 
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
+#include "vtkDataArray.h"
 #include "vtkPolyDataAlgorithm.h"
 
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
 class connect_points : public vtkPolyDataAlgorithm
 {
 public:
     static connect_points *New();
     vtkTypeMacro(connect_points, vtkPolyDataAlgorithm);
 
+    vtkSetMacro(GroupByArray, int);
+    vtkGetMacro(GroupByArray, int);
+
+    vtkSetMacro(SortByKey, int);
+    vtkGetMacro(SortByKey, int);
+
 protected:
     connect_points();
 
@@ -20,4 +31,37 @@ protected:
 private:
     connect_points(const connect_points&);
     void operator=(const connect_points&);
+
+    /*
+     * Compute sort keys from the values of a scalar array, offset by the minimum key
+     *
+     * @param array Scalar point data array
+     * @param num_points Number of points
+     * @param keys Output keys, in the same order as the values
+     * @param num_bits Output number of bits necessary to represent all keys
+     *
+     * @return False if the array is not a valid scalar point data array, true otherwise
+     */
+    bool compute_keys(vtkDataArray* array, vtkIdType num_points, std::vector<std::uint64_t>& keys, int& num_bits) const;
+
+    /// Compute sort keys in parallel, with direct access to the values
+    template <typename value_t>
+    static void compute_keys(const value_t* values, std::vector<std::uint64_t>& keys);
+
+    /// Convert a value to an unsigned integer, preserving the order of values
+    template <typename value_t>
+    static std::uint64_t to_key(value_t value);
+
+    template <typename value_t>
+    static std::uint64_t to_key(value_t value, std::true_type, std::true_type);
+
+    template <typename value_t>
+    static std::uint64_t to_key(value_t value, std::false_type, std::true_type);
+
+    template <typename value_t>
+    static std::uint64_t to_key(value_t value, std::false_type, std::false_type);
+
+    /// Parameters
+    int GroupByArray;
+    int SortByKey;
 };
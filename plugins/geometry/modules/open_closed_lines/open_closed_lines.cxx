@@ -1,18 +1,30 @@
 #include "open_closed_lines.h"
 
 #include "vtkCellData.h"
+#include "vtkDataArray.h"
 #include "vtkDataObject.h"
-#include "vtkIdList.h"
+#include "vtkDataSetAttributes.h"
 #include "vtkIdTypeArray.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
+#include "vtkMath.h"
 #include "vtkObjectFactory.h"
 #include "vtkPointData.h"
+#include "vtkPoints.h"
 #include "vtkPolyData.h"
+#include "vtkSMPTools.h"
 #include "vtkSmartPointer.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
+#include "common/line_cells.h"
+#include "common/line_data.h"
+
+#include <algorithm>
 #include <array>
+#include <cstring>
+#include <iostream>
+#include <numeric>
+#include <vector>
 
 vtkStandardNewMacro(open_closed_lines);
 
@@ -48,79 +60,206 @@ int open_closed_lines::RequestData(vtkInformation*, vtkInformationVector** input
     auto* out_info = output_vector->GetInformationObject(0);
     auto* output = vtkPolyData::SafeDownCast(out_info->Get(vtkDataObject::DATA_OBJECT()));
 
+    // Check parameters
+    if (this->Closure == 1 && this->Tolerance < 0.0)
+    {
+        std::cerr << "Tolerance must not be negative" << std::endl;
+        return 0;
+    }
+
+    // Get lines
+    const line_view lines(input->GetLines());
+    const auto num_lines = lines.size();
+
+    // Find closed lines, either by identical indices of the first and last point, or by their distance
+    const auto tolerance_squared = this->Tolerance * this->Tolerance;
+
+    std::vector<unsigned char> closed(num_lines, 0);
+
+    auto find_closed = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
+        {
+            if (lines.size(line_index) > 1)
+            {
+                const auto first = *lines.begin(line_index);
+                const auto last = *(lines.end(line_index) - 1);
+
+                closed[line_index] = (first == last);
+
+                if (!closed[line_index] && this->Closure == 1)
+                {
+                    std::array<double, 3> first_point, last_point;
+                    input->GetPoint(first, first_point.data());
+                    input->GetPoint(last, last_point.data());
+
+                    closed[line_index] = vtkMath::Distance2BetweenPoints(first_point.data(), last_point.data()) <= tolerance_squared;
+                }
+            }
+        }
+    };
+
+    vtkSMPTools::For(0, num_lines, find_closed);
+
     // Open closed lines depending on method
-    auto cell_ids = vtkSmartPointer<vtkIdTypeArray>::New();
-    cell_ids->SetNumberOfComponents(1);
-    cell_ids->Allocate(input->GetLines()->GetData()->GetNumberOfValues());
+    line_builder output_lines(num_lines);
 
     if (this->Method == 0)
     {
         // Remove last segment
-        input->GetLines()->InitTraversal();
-
-        auto point_ids = vtkSmartPointer<vtkIdList>::New();
-
-        while (input->GetLines()->GetNextCell(point_ids))
+        auto size_range = [&](const vtkIdType begin, const vtkIdType end)
         {
-            vtkIdType new_size = point_ids->GetNumberOfIds();
-
-            if (point_ids->GetId(0) == point_ids->GetId(point_ids->GetNumberOfIds() - 1))
+            for (vtkIdType line_index = begin; line_index < end; ++line_index)
             {
-                --new_size;
+                output_lines.set_size(line_index, lines.size(line_index) - (closed[line_index] ? 1 : 0));
             }
+        };
+
+        vtkSMPTools::For(0, num_lines, size_range);
 
-            cell_ids->InsertNextValue(new_size);
+        output_lines.allocate();
 
-            for (vtkIdType i = 0; i < new_size; ++i)
+        auto write_range = [&](const vtkIdType begin, const vtkIdType end)
+        {
+            for (vtkIdType line_index = begin; line_index < end; ++line_index)
             {
-                cell_ids->InsertNextValue(point_ids->GetId(i));
+                std::copy(lines.begin(line_index), lines.begin(line_index) + output_lines.size(line_index), output_lines.begin(line_index));
             }
-        }
+        };
 
-        // Copy points
+        vtkSMPTools::For(0, num_lines, write_range);
+
+        // Copy points and point data
         output->SetPoints(input->GetPoints());
+        output->GetPointData()->ShallowCopy(input->GetPointData());
     }
     else
     {
-        // Duplicate shared point
-        input->GetLines()->InitTraversal();
-
-        auto point_ids = vtkSmartPointer<vtkIdList>::New();
+        // Duplicate shared point, which is only necessary if the first and last point are the same;
+        // precompute the index of each duplicated point, appended after the input points
+        std::vector<vtkIdType> duplicate_offsets(num_lines + 1, 0);
 
-        auto new_points = vtkSmartPointer<vtkPoints>::New();
-        new_points->DeepCopy(input->GetPoints());
-
-        while (input->GetLines()->GetNextCell(point_ids))
+        auto size_range = [&](const vtkIdType begin, const vtkIdType end)
         {
-            cell_ids->InsertNextValue(point_ids->GetNumberOfIds());
-
-            for (vtkIdType i = 0; i < point_ids->GetNumberOfIds() - 1; ++i)
+            for (vtkIdType line_index = begin; line_index < end; ++line_index)
             {
-                cell_ids->InsertNextValue(point_ids->GetId(i));
+                output_lines.set_size(line_index, lines.size(line_index));
+
+                duplicate_offsets[line_index + 1] = (closed[line_index] && *lines.begin(line_index) == *(lines.end(line_index) - 1)) ? 1 : 0;
             }
+        };
+
+        vtkSMPTools::For(0, num_lines, size_range);
+
+        std::partial_sum(duplicate_offsets.begin(), duplicate_offsets.end(), duplicate_offsets.begin());
+
+        output_lines.allocate();
 
-            if (point_ids->GetId(0) == point_ids->GetId(point_ids->GetNumberOfIds() - 1))
+        const auto num_input_points = input->GetNumberOfPoints();
+
+        std::vector<vtkIdType> duplicated_points(duplicate_offsets[num_lines]);
+
+        auto write_range = [&](const vtkIdType begin, const vtkIdType end)
+        {
+            for (vtkIdType line_index = begin; line_index < end; ++line_index)
             {
-                std::array<double, 3> point;
-                new_points->GetPoint(point_ids->GetId(0), point.data());
+                auto* output_line = std::copy(lines.begin(line_index), lines.end(line_index), output_lines.begin(line_index));
 
-                cell_ids->InsertNextValue(new_points->InsertNextPoint(point.data()));
+                if (duplicate_offsets[line_index + 1] != duplicate_offsets[line_index])
+                {
+                    duplicated_points[duplicate_offsets[line_index]] = *lines.begin(line_index);
+                    *(output_line - 1) = num_input_points + duplicate_offsets[line_index];
+                }
             }
-            else
+        };
+
+        vtkSMPTools::For(0, num_lines, write_range);
+
+        // Create points and point data, allocated once and extended by the duplicated points
+        auto points = vtkSmartPointer<vtkPoints>::New();
+        points->SetData(vtkDataArray::SafeDownCast(extend_array(input->GetPoints()->GetData(), duplicated_points)));
+
+        output->SetPoints(points);
+
+        for (int array_index = 0; array_index < input->GetPointData()->GetNumberOfArrays(); ++array_index)
+        {
+            output->GetPointData()->AddArray(extend_array(input->GetPointData()->GetAbstractArray(array_index), duplicated_points));
+        }
+
+        // Set active attributes, e.g., scalars and vectors, as arrays are stored in the same order as in the input
+        int attribute_indices[vtkDataSetAttributes::NUM_ATTRIBUTES];
+        input->GetPointData()->GetAttributeIndices(attribute_indices);
+
+        for (int attribute = 0; attribute < vtkDataSetAttributes::NUM_ATTRIBUTES; ++attribute)
+        {
+            if (attribute_indices[attribute] >= 0)
             {
-                cell_ids->InsertNextValue(point_ids->GetId(point_ids->GetNumberOfIds() - 1));
+                output->GetPointData()->SetActiveAttribute(attribute_indices[attribute], attribute);
             }
         }
-
-        // Set points
-        output->SetPoints(new_points);
     }
 
     // Create cells
-    auto cells = vtkSmartPointer<vtkCellArray>::New();
-    cells->SetCells(input->GetLines()->GetNumberOfCells(), cell_ids);
+    output->SetLines(output_lines.build());
 
-    output->SetLines(cells);
+    // Copy cell data from the source lines, which are mapped one-to-one
+    std::vector<vtkIdType> source_lines(num_lines);
+    std::iota(source_lines.begin(), source_lines.end(), 0);
+
+    copy_line_data(input, output, source_lines.data());
 
     return 1;
 }
+
+vtkSmartPointer<vtkAbstractArray> open_closed_lines::extend_array(vtkAbstractArray* in_array, const std::vector<vtkIdType>& duplicated_points) const
+{
+    const auto num_tuples = in_array->GetNumberOfTuples();
+    const auto num_duplicates = static_cast<vtkIdType>(duplicated_points.size());
+
+    vtkSmartPointer<vtkAbstractArray> out_array;
+    out_array.TakeReference(in_array->NewInstance());
+    out_array->SetName(in_array->GetName());
+    out_array->SetNumberOfComponents(in_array->GetNumberOfComponents());
+    out_array->SetNumberOfTuples(num_tuples + num_duplicates);
+
+    if (vtkDataArray::SafeDownCast(in_array) != nullptr && in_array->HasStandardMemoryLayout())
+    {
+        // Copy contiguous memory in parallel, and set duplicated tuples at their precomputed position
+        const auto tuple_size = static_cast<std::size_t>(in_array->GetNumberOfComponents() * in_array->GetDataTypeSize());
+
+        const auto* in_values = static_cast<const char*>(in_array->GetVoidPointer(0));
+        auto* out_values = static_cast<char*>(out_array->GetVoidPointer(0));
+
+        auto copy_range = [&](const vtkIdType begin, const vtkIdType end)
+        {
+            std::memcpy(out_values + begin * tuple_size, in_values + begin * tuple_size, (end - begin) * tuple_size);
+        };
+
+        vtkSMPTools::For(0, num_tuples, copy_range);
+
+        auto duplicate_range = [&](const vtkIdType begin, const vtkIdType end)
+        {
+            for (vtkIdType index = begin; index < end; ++index)
+            {
+                std::memcpy(out_values + (num_tuples + index) * tuple_size, in_values + duplicated_points[index] * tuple_size, tuple_size);
+            }
+        };
+
+        vtkSMPTools::For(0, num_duplicates, duplicate_range);
+    }
+    else
+    {
+        // Copy other arrays, e.g., string arrays, tuple by tuple
+        for (vtkIdType index = 0; index < num_tuples; ++index)
+        {
+            out_array->SetTuple(index, index, in_array);
+        }
+
+        for (vtkIdType index = 0; index < num_duplicates; ++index)
+        {
+            out_array->SetTuple(num_tuples + index, duplicated_points[index], in_array);
+        }
+    }
+
+    return out_array;
+}
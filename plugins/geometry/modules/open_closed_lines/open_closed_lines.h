@@ -2,7 +2,11 @@
 
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
+#include "vtkAbstractArray.h"
 #include "vtkPolyDataAlgorithm.h"
+#include "vtkSmartPointer.h"
+
+#include <vector>
 
 class open_closed_lines : public vtkPolyDataAlgorithm
 {
@@ -13,6 +17,12 @@ public:
     vtkSetMacro(Method, int);
     vtkGetMacro(Method, int);
 
+    vtkSetMacro(Closure, int);
+    vtkGetMacro(Closure, int);
+
+    vtkSetMacro(Tolerance, double);
+    vtkGetMacro(Tolerance, double);
+
 protected:
     open_closed_lines();
 
@@ -24,6 +34,18 @@ private:
     open_closed_lines(const open_closed_lines&);
     void operator=(const open_closed_lines&);
 
+    /*
+     * Create a copy of the array, extended by the tuples of duplicated points
+     *
+     * @param in_array Input array
+     * @param duplicated_points Indices of the points whose tuples are appended
+     *
+     * @return Extended array
+     */
+    vtkSmartPointer<vtkAbstractArray> extend_array(vtkAbstractArray* in_array, const std::vector<vtkIdType>& duplicated_points) const;
+
     /// Parameters
     int Method;
+    int Closure;
+    double Tolerance;
 };
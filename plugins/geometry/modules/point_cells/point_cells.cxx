@@ -1,8 +1,9 @@
 #include "point_cells.h"
 
+#include "common/iota_cells.h"
+
 #include "vtkCellArray.h"
 #include "vtkDataObject.h"
-#include "vtkIdTypeArray.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkObjectFactory.h"
@@ -50,19 +51,8 @@ int point_cells::RequestData(vtkInformation*, vtkInformationVector** input_vecto
     output->SetPoints(input->GetPoints());
     output->GetPointData()->ShallowCopy(input->GetPointData());
 
-    // Create cells
-    auto cell_indices = vtkSmartPointer<vtkIdTypeArray>::New();
-    cell_indices->SetNumberOfComponents(1);
-    cell_indices->Allocate(input->GetNumberOfPoints() * 2);
-
-    for (vtkIdType index = 0; index < input->GetNumberOfPoints(); ++index)
-    {
-        cell_indices->InsertNextValue(1);
-        cell_indices->InsertNextValue(index);
-    }
-
-    auto cells = vtkSmartPointer<vtkCellArray>::New();
-    cells->SetCells(input->GetNumberOfPoints(), cell_indices);
+    // Create cells from arrays of consecutive indices, filled in parallel
+    auto cells = vertex_cells(input->GetNumberOfPoints());
 
     output->SetVerts(cells);
 
@@ -2,19 +2,28 @@
 
 #include "vtkCellData.h"
 #include "vtkDataObject.h"
-#include "vtkIdList.h"
 #include "vtkIdTypeArray.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkObjectFactory.h"
 #include "vtkPointData.h"
+#include "vtkPoints.h"
 #include "vtkPolyData.h"
+#include "vtkSMPThreadLocal.h"
+#include "vtkSMPTools.h"
 #include "vtkSmartPointer.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
+#include "common/line_cells.h"
+#include "common/line_data.h"
+
 #include <algorithm>
-#include <array>
 #include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <iostream>
+#include <limits>
+#include <numeric>
 #include <vector>
 
 vtkStandardNewMacro(remove_long_segments);
@@ -51,94 +60,312 @@ int remove_long_segments::RequestData(vtkInformation*, vtkInformationVector** in
     auto* out_info = output_vector->GetInformationObject(0);
     auto* output = vtkPolyData::SafeDownCast(out_info->Get(vtkDataObject::DATA_OBJECT()));
 
-    // Get lines and remove long segments
-    std::vector<std::vector<vtkIdType>> lines;
+    // Check parameters
+    if (this->Statistics == 2 && this->WindowSize < 1)
+    {
+        std::cerr << "Window size must be positive" << std::endl;
+        return 0;
+    }
 
-    input->GetLines()->InitTraversal();
-    auto point_ids = vtkSmartPointer<vtkIdList>::New();
+    // Get lines
+    const line_view lines(input->GetLines());
+    const auto num_lines = lines.size();
 
-    while (input->GetLines()->GetNextCell(point_ids))
-    {
-        // Get median length
-        std::vector<double> lengths(point_ids->GetNumberOfIds() - 1);
+    // Mark segments above the threshold, and count the resulting cells per line
+    std::vector<unsigned char> breaks(lines.storage_size(), 0);
+    std::vector<vtkIdType> cell_offsets(num_lines + 1, 0);
 
-        for (vtkIdType i = 0; i < point_ids->GetNumberOfIds() - 1; ++i)
+    if (input->GetPoints() != nullptr && input->GetPoints()->GetData()->HasStandardMemoryLayout())
+    {
+        switch (input->GetPoints()->GetDataType())
         {
-            std::array<double, 3> point_1, point_2;
-            input->GetPoint(point_ids->GetId(i), point_1.data());
-            input->GetPoint(point_ids->GetId(i + 1), point_2.data());
+            vtkTemplateMacro(mark_long_segments(static_cast<const VTK_TT*>(input->GetPoints()->GetData()->GetVoidPointer(0)),
+                lines, breaks, cell_offsets));
+        }
+    }
+    else if (input->GetPoints() != nullptr)
+    {
+        // Convert coordinates without contiguous memory explicitly, instead of accessing a temporary copy
+        std::vector<double> coordinates(3 * input->GetNumberOfPoints());
 
-            lengths[i] = std::sqrt(std::pow(point_1[0] - point_2[0], 2.0) + std::pow(point_1[1] - point_2[1], 2.0) + std::pow(point_1[2] - point_2[2], 2.0));
+        for (vtkIdType index = 0; index < input->GetNumberOfPoints(); ++index)
+        {
+            input->GetPoint(index, &coordinates[3 * index]);
         }
 
-        std::nth_element(lengths.begin(), lengths.begin() + lengths.size() / 2, lengths.end());
-        const auto median_length = lengths[lengths.size() / 2];
+        mark_long_segments(coordinates.data(), lines, breaks, cell_offsets);
+    }
+
+    // Compute output positions for each line
+    std::partial_sum(cell_offsets.begin(), cell_offsets.end(), cell_offsets.begin());
+
+    // Create cells, splitting the lines at the marked segments into pieces consisting of at least one segment
+    line_builder output_lines(cell_offsets[num_lines]);
+    std::vector<vtkIdType> source_lines(cell_offsets[num_lines]);
+
+    auto piece_end = [&lines, &breaks](const vtkIdType line_index, vtkIdType i) -> vtkIdType
+    {
+        const auto* line_breaks = breaks.data() + lines.offset(line_index);
 
-        // Remove segments above the threshold
-        const auto threshold = this->LengthFactor * median_length;
+        for (++i; i < lines.size(line_index) && !line_breaks[i]; ++i);
 
-        // Remove segments above the threshold
-        lines.emplace_back();
-        lines.back().push_back(point_ids->GetId(0));
+        return i;
+    };
 
-        for (vtkIdType i = 0; i < point_ids->GetNumberOfIds() - 1; ++i)
+    auto set_sizes = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
         {
-            std::array<double, 3> point_1, point_2;
-            input->GetPoint(point_ids->GetId(i), point_1.data());
-            input->GetPoint(point_ids->GetId(i + 1), point_2.data());
+            auto cell = cell_offsets[line_index];
+
+            for (vtkIdType i = 0, j = 0; i < lines.size(line_index); i = j)
+            {
+                j = piece_end(line_index, i);
+
+                if (j - i > 1)
+                {
+                    output_lines.set_size(cell, j - i);
+                    source_lines[cell++] = line_index;
+                }
+            }
+        }
+    };
 
-            const auto length = std::sqrt(std::pow(point_1[0] - point_2[0], 2.0) + std::pow(point_1[1] - point_2[1], 2.0) + std::pow(point_1[2] - point_2[2], 2.0));
+    vtkSMPTools::For(0, num_lines, set_sizes);
 
-            if (length > threshold && !lines.back().empty())
+    output_lines.allocate();
+
+    auto write_lines = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
+        {
+            auto cell = cell_offsets[line_index];
+
+            for (vtkIdType i = 0, j = 0; i < lines.size(line_index); i = j)
             {
-                lines.emplace_back();
+                j = piece_end(line_index, i);
+
+                if (j - i > 1)
+                {
+                    std::copy(lines.begin(line_index) + i, lines.begin(line_index) + j, output_lines.begin(cell++));
+                }
             }
+        }
+    };
+
+    vtkSMPTools::For(0, num_lines, write_lines);
+
+    output->SetLines(output_lines.build());
+
+    // Copy cell data from the source lines
+    copy_line_data(input, output, source_lines.data());
+
+    // Copy points
+    auto points = vtkSmartPointer<vtkPoints>::New();
+    points->ShallowCopy(input->GetPoints());
+
+    output->SetPoints(points);
+
+    // Copy point data, as the points are unchanged
+    output->GetPointData()->ShallowCopy(input->GetPointData());
+
+    return 1;
+}
+
+template <typename value_t>
+double remove_long_segments::segment_length(const value_t* coordinates, const vtkIdType point_1, const vtkIdType point_2)
+{
+    const auto dx = static_cast<double>(coordinates[3 * point_2 + 0]) - static_cast<double>(coordinates[3 * point_1 + 0]);
+    const auto dy = static_cast<double>(coordinates[3 * point_2 + 1]) - static_cast<double>(coordinates[3 * point_1 + 1]);
+    const auto dz = static_cast<double>(coordinates[3 * point_2 + 2]) - static_cast<double>(coordinates[3 * point_1 + 2]);
+
+    return std::sqrt(dx * dx + dy * dy + dz * dz);
+}
+
+template <typename value_t>
+double remove_long_segments::global_median_length(const value_t* coordinates, const line_view& lines) const
+{
+    // Use the upper bits of the single-precision representation of the (non-negative) lengths as bins,
+    // which results in a logarithmic histogram with a relative bin width of 2^-4
+    constexpr int shift = 19;
+    constexpr std::size_t num_bins = std::size_t(1) << (31 - shift);
+
+    auto bin_bound = [](const std::size_t bin) -> double
+    {
+        const auto bits = static_cast<std::uint32_t>(bin << shift);
+
+        float value;
+        std::memcpy(&value, &bits, sizeof(float));
+
+        return static_cast<double>(value);
+    };
+
+    // Compute histograms per thread
+    vtkSMPThreadLocal<std::vector<vtkIdType>> local_histograms;
+
+    auto count_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        auto& histogram = local_histograms.Local();
+        histogram.resize(num_bins, 0);
 
-            lines.back().push_back(point_ids->GetId(i + 1));
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
+        {
+            const auto* line = lines.begin(line_index);
+            const auto num_points = lines.size(line_index);
+
+            for (vtkIdType i = 0; i < num_points - 1; ++i)
+            {
+                const auto length = std::min(static_cast<float>(segment_length(coordinates, line[i], line[i + 1])), std::numeric_limits<float>::max());
+
+                std::uint32_t bits;
+                std::memcpy(&bits, &length, sizeof(float));
+
+                ++histogram[bits >> shift];
+            }
+        }
+    };
+
+    vtkSMPTools::For(0, lines.size(), count_range);
+
+    std::vector<vtkIdType> histogram(num_bins, 0);
+
+    for (const auto& thread_histogram : local_histograms)
+    {
+        for (std::size_t bin = 0; bin < thread_histogram.size(); ++bin)
+        {
+            histogram[bin] += thread_histogram[bin];
         }
     }
 
-    // Count number of cells and points
-    std::size_t num_points = 0;
-    std::size_t num_cells = 0;
+    // Find the bin containing the median, and interpolate linearly within the bin
+    const auto num_segments = std::accumulate(histogram.begin(), histogram.end(), static_cast<vtkIdType>(0));
+    const auto median_rank = num_segments / 2;
+
+    vtkIdType rank = 0;
 
-    for (const auto& line : lines)
+    for (std::size_t bin = 0; bin < num_bins; ++bin)
     {
-        if (line.size() > 1)
+        if (rank + histogram[bin] > median_rank)
         {
-            ++num_cells;
-            num_points += line.size();
+            const auto fraction = (median_rank - rank + 0.5) / histogram[bin];
+
+            return bin_bound(bin) + fraction * (bin_bound(bin + 1) - bin_bound(bin));
         }
+
+        rank += histogram[bin];
     }
 
-    // Create cells
-    auto cell_ids = vtkSmartPointer<vtkIdTypeArray>::New();
-    cell_ids->SetNumberOfComponents(1);
-    cell_ids->Allocate(static_cast<vtkIdType>(num_cells + num_points));
+    return 0.0;
+}
 
-    for (const auto& line : lines)
+template <typename value_t>
+void remove_long_segments::mark_long_segments(const value_t* coordinates, const line_view& lines,
+    std::vector<unsigned char>& breaks, std::vector<vtkIdType>& cell_offsets) const
+{
+    // For global statistics, the median length is the same for all lines
+    const auto global_median = (this->Statistics == 1) ? global_median_length(coordinates, lines) : 0.0;
+    const vtkIdType half_window = std::max(this->WindowSize, 1) / 2;
+
+    struct buffers_t
     {
-        if (line.size() > 1)
+        std::vector<double> lengths;
+        std::vector<double> sorted_lengths;
+    };
+
+    vtkSMPThreadLocal<buffers_t> local_buffers;
+
+    auto mark_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        auto& lengths = local_buffers.Local().lengths;
+        auto& sorted_lengths = local_buffers.Local().sorted_lengths;
+
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
         {
-            cell_ids->InsertNextValue(static_cast<vtkIdType>(line.size()));
+            const auto* line = lines.begin(line_index);
+            auto* line_breaks = breaks.data() + lines.offset(line_index);
+            const auto num_points = lines.size(line_index);
 
-            for (const auto point_id : line)
+            // Lines without segments are removed
+            if (num_points < 2)
             {
-                cell_ids->InsertNextValue(point_id);
+                continue;
             }
-        }
-    }
 
-    auto cells = vtkSmartPointer<vtkCellArray>::New();
-    cells->SetCells(static_cast<vtkIdType>(num_cells), cell_ids);
+            // Compute segment lengths
+            const auto num_segments = num_points - 1;
 
-    output->SetLines(cells);
+            lengths.resize(num_segments);
 
-    // Copy points
-    auto points = vtkSmartPointer<vtkPoints>::New();
-    points->ShallowCopy(input->GetPoints());
+            for (vtkIdType i = 0; i < num_segments; ++i)
+            {
+                lengths[i] = segment_length(coordinates, line[i], line[i + 1]);
+            }
 
-    output->SetPoints(points);
+            // Get median length of the line, or initialize the sliding window for windowed statistics,
+            // which is kept sorted and contains the lengths of the segments [i - half_window, i + half_window]
+            auto median_length = global_median;
 
-    return 1;
+            if (this->Statistics == 0)
+            {
+                sorted_lengths.assign(lengths.begin(), lengths.end());
+
+                std::nth_element(sorted_lengths.begin(), sorted_lengths.begin() + sorted_lengths.size() / 2, sorted_lengths.end());
+                median_length = sorted_lengths[sorted_lengths.size() / 2];
+            }
+            else if (this->Statistics == 2)
+            {
+                sorted_lengths.assign(lengths.begin(), lengths.begin() + std::min(half_window + 1, num_segments));
+                std::sort(sorted_lengths.begin(), sorted_lengths.end());
+            }
+
+            // Mark segments above the threshold, starting a new line at their second point
+            vtkIdType num_cells = 0;
+            vtkIdType piece_size = 1;
+
+            for (vtkIdType i = 0; i < num_segments; ++i)
+            {
+                if (this->Statistics == 2)
+                {
+                    median_length = sorted_lengths[sorted_lengths.size() / 2];
+
+                    // Slide window to the next segment
+                    if (i + half_window + 1 < num_segments)
+                    {
+                        const auto length = lengths[i + half_window + 1];
+                        sorted_lengths.insert(std::upper_bound(sorted_lengths.begin(), sorted_lengths.end(), length), length);
+                    }
+
+                    if (i - half_window >= 0)
+                    {
+                        sorted_lengths.erase(std::lower_bound(sorted_lengths.begin(), sorted_lengths.end(), lengths[i - half_window]));
+                    }
+                }
+
+                if (lengths[i] > this->LengthFactor * median_length)
+                {
+                    line_breaks[i + 1] = 1;
+
+                    if (piece_size > 1)
+                    {
+                        ++num_cells;
+                    }
+
+                    piece_size = 1;
+                }
+                else
+                {
+                    ++piece_size;
+                }
+            }
+
+            if (piece_size > 1)
+            {
+                ++num_cells;
+            }
+
+            cell_offsets[line_index + 1] = num_cells;
+        }
+    };
+
+    vtkSMPTools::For(0, lines.size(), mark_range);
 }
@@ -4,6 +4,10 @@
 #include "vtkInformationVector.h"
 #include "vtkPolyDataAlgorithm.h"
 
+#include <vector>
+
+class line_view;
+
 class remove_long_segments : public vtkPolyDataAlgorithm
 {
 public:
@@ -13,6 +17,12 @@ public:
     vtkSetMacro(LengthFactor, double);
     vtkGetMacro(LengthFactor, double);
 
+    vtkSetMacro(Statistics, int);
+    vtkGetMacro(Statistics, int);
+
+    vtkSetMacro(WindowSize, int);
+    vtkGetMacro(WindowSize, int);
+
 protected:
     remove_long_segments();
 
@@ -24,6 +34,36 @@ private:
     remove_long_segments(const remove_long_segments&);
     void operator=(const remove_long_segments&);
 
+    /// Compute the length of the segment between two points
+    template <typename value_t>
+    static double segment_length(const value_t* coordinates, vtkIdType point_1, vtkIdType point_2);
+
+    /*
+     * Compute the approximate median length of all segments from a logarithmic histogram
+     *
+     * @param coordinates Point coordinates
+     * @param lines Input lines
+     *
+     * @return Approximate median segment length
+     */
+    template <typename value_t>
+    double global_median_length(const value_t* coordinates, const line_view& lines) const;
+
+    /*
+     * Mark segments that are longer than the length factor times the median segment length,
+     * where the median is computed per line, over all lines, or in a window around each segment
+     *
+     * @param coordinates Point coordinates
+     * @param lines Input lines
+     * @param breaks Output flags at the storage position of the first point of each new line
+     * @param cell_offsets Output number of resulting cells per line, stored at the position of the next line
+     */
+    template <typename value_t>
+    void mark_long_segments(const value_t* coordinates, const line_view& lines,
+        std::vector<unsigned char>& breaks, std::vector<vtkIdType>& cell_offsets) const;
+
     /// Parameters
     double LengthFactor;
+    int Statistics;
+    int WindowSize;
 };
@@ -1,17 +1,27 @@
 #include "smooth_lines.h"
 
+#include "vtkCellArray.h"
+#include "vtkCellData.h"
 #include "vtkDataObject.h"
+#include "vtkDoubleArray.h"
+#include "vtkIdList.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
+#include "vtkIntArray.h"
 #include "vtkObjectFactory.h"
+#include "vtkPoints.h"
 #include "vtkPolyData.h"
+#include "vtkSMPThreadLocal.h"
+#include "vtkSMPTools.h"
 #include "vtkSmartPointer.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
 #include "Eigen/Dense"
 
+#include <algorithm>
 #include <cmath>
 #include <iostream>
+#include <numeric>
 #include <vector>
 
 vtkStandardNewMacro(smooth_lines);
@@ -73,52 +83,452 @@ int smooth_lines::RequestData(vtkInformation*, vtkInformationVector** input_vect
         return 0;
     }
 
-    // Copy input to output and work on that copy
-    output->DeepCopy(input);
+    if (this->Convergence && this->Tolerance <= 0.0)
+    {
+        std::cerr << "The convergence tolerance must be positive" << std::endl;
+        return 0;
+    }
 
-    // Line-wise
-    output->GetLines()->InitTraversal();
+    if (this->Method != 0 && this->TimeStep <= 0.0)
+    {
+        std::cerr << "The time step for implicit smoothing must be positive" << std::endl;
+        return 0;
+    }
 
-    auto point_indices = vtkSmartPointer<vtkIdList>::New();
+    if (this->Method != 0 && this->Connectivity != 0)
+    {
+        std::cerr << "Implicit smoothing is only available for line-wise smoothing" << std::endl;
+        return 0;
+    }
 
-    while (output->GetLines()->GetNextCell(point_indices))
+    // Output empty points and lines for input without points
+    if (input->GetPoints() == nullptr)
     {
-        std::vector<Eigen::Vector3d> points(point_indices->GetNumberOfIds()), temp_points(point_indices->GetNumberOfIds());
+        output->SetPoints(vtkSmartPointer<vtkPoints>::New());
+        output->SetLines(vtkSmartPointer<vtkCellArray>::New());
 
+        return 1;
+    }
+
+    // Share topology and attributes with the input, and only create new point coordinates
+    output->ShallowCopy(input);
+
+    auto smoothed_points = vtkSmartPointer<vtkPoints>::New();
+    smoothed_points->DeepCopy(input->GetPoints());
+
+    output->SetPoints(smoothed_points);
+
+    // Create arrays for the number of iterations and the final residual, with one entry per cell
+    auto iterations = vtkSmartPointer<vtkIntArray>::New();
+    iterations->SetNumberOfComponents(1);
+    iterations->SetNumberOfTuples(input->GetNumberOfCells());
+    iterations->SetName("Iterations");
+    iterations->FillValue(0);
+
+    auto residuals = vtkSmartPointer<vtkDoubleArray>::New();
+    residuals->SetNumberOfComponents(1);
+    residuals->SetNumberOfTuples(input->GetNumberOfCells());
+    residuals->SetName("Residual");
+    residuals->FillValue(0.0);
+
+    // Smooth either each line on its own, or all lines at once on the graph of connected points
+    if (this->Connectivity == 0)
+    {
+        smooth_line_wise(input, smoothed_points, iterations, residuals);
+    }
+    else
+    {
+        smooth_shared_points(input, smoothed_points, iterations, residuals);
+    }
+
+    output->GetCellData()->AddArray(iterations);
+    output->GetCellData()->AddArray(residuals);
+
+    return 1;
+}
+
+void smooth_lines::smooth_line_wise(vtkPolyData* input, vtkPoints* smoothed_points, vtkIntArray* iterations, vtkDoubleArray* residuals) const
+{
+    // Gather lines for random access, and assign each point to the last line containing it
+    std::vector<vtkIdType> line_offsets(1, 0);
+    line_offsets.reserve(input->GetLines()->GetNumberOfCells() + 1);
+
+    std::vector<vtkIdType> line_point_indices;
+    std::vector<vtkIdType> point_owners(input->GetNumberOfPoints(), -1);
+
+    input->GetLines()->InitTraversal();
+
+    auto point_indices = vtkSmartPointer<vtkIdList>::New();
+
+    while (input->GetLines()->GetNextCell(point_indices))
+    {
         for (vtkIdType index = 0; index < point_indices->GetNumberOfIds(); ++index)
         {
-            output->GetPoints()->GetPoint(point_indices->GetId(index), points[index].data());
+            line_point_indices.push_back(point_indices->GetId(index));
+            point_owners[point_indices->GetId(index)] = static_cast<vtkIdType>(line_offsets.size() - 1);
+        }
+
+        line_offsets.push_back(static_cast<vtkIdType>(line_point_indices.size()));
+    }
+
+    // Smooth lines in parallel, re-using the buffers of each thread
+    struct buffers_t
+    {
+        std::vector<Eigen::Vector3d> points, temp_points;
+        std::vector<double> lower, diagonal, upper, scratch, correction;
+    };
+
+    vtkSMPThreadLocal<buffers_t> local_buffers;
+
+    auto smooth_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        auto& buffers = local_buffers.Local();
+        auto& points = buffers.points;
+        auto& temp_points = buffers.temp_points;
+
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
+        {
+            const auto* line = line_point_indices.data() + line_offsets[line_index];
+            const auto line_size = line_offsets[line_index + 1] - line_offsets[line_index];
+
+            // Closed lines store their first point again at the end; smooth the loop without this duplicate
+            const auto closed = line_size > 2 && line[0] == line[line_size - 1];
+
+            const auto num_points = line_size - (closed ? 1 : 0);
+
+            points.resize(num_points);
+            temp_points.resize(num_points);
+
+            for (vtkIdType index = 0; index < num_points; ++index)
+            {
+                input->GetPoints()->GetPoint(line[index], points[index].data());
+            }
+
+            int num_iterations = 0;
+            double max_displacement = 0.0;
+
+            if (this->Method == 0)
+            {
+                // Apply Taubin smoothing, until the maximum displacement falls below the tolerance, if requested
+                for (; num_iterations < this->NumIterations && !converged(max_displacement, num_iterations); ++num_iterations)
+                {
+                    for (std::size_t index = 0; index < points.size(); ++index)
+                    {
+                        temp_points[index] = gaussian_smoothing(points, index, this->Lambda, closed);
+                    }
+
+                    max_displacement = 0.0;
+
+                    for (std::size_t index = 0; index < points.size(); ++index)
+                    {
+                        const auto smoothed_point = gaussian_smoothing(temp_points, index, this->Mu, closed);
+
+                        max_displacement = std::max(max_displacement, (smoothed_point - points[index]).squaredNorm());
+                        points[index] = smoothed_point;
+                    }
+                }
+            }
+            else if (num_points > 1)
+            {
+                // Apply a single implicit smoothing step
+                std::copy(points.begin(), points.end(), temp_points.begin());
+
+                implicit_smoothing(points, closed, buffers.lower, buffers.diagonal, buffers.upper, buffers.scratch, buffers.correction);
+
+                for (vtkIdType index = 0; index < num_points; ++index)
+                {
+                    max_displacement = std::max(max_displacement, (points[index] - temp_points[index]).squaredNorm());
+                }
+
+                num_iterations = 1;
+            }
+
+            // Lines are stored after the vertices in the poly data cell order
+            iterations->SetValue(input->GetNumberOfVerts() + line_index, num_iterations);
+            residuals->SetValue(input->GetNumberOfVerts() + line_index, std::sqrt(max_displacement));
+
+            // Write smoothed points to output, where points shared by multiple lines are written by only one of them
+            for (vtkIdType index = 0; index < num_points; ++index)
+            {
+                if (point_owners[line[index]] == line_index)
+                {
+                    smoothed_points->SetPoint(line[index], points[index].data());
+                }
+            }
+        }
+    };
+
+    vtkSMPTools::For(0, static_cast<vtkIdType>(line_offsets.size() - 1), smooth_range);
+
+    smoothed_points->Modified();
+}
+
+void smooth_lines::implicit_smoothing(std::vector<Eigen::Vector3d>& points, const bool closed, std::vector<double>& lower,
+    std::vector<double>& diagonal, std::vector<double>& upper, std::vector<double>& scratch, std::vector<double>& correction) const
+{
+    // Set up the matrix (I + tL) of the backward Euler step, where L is the graph Laplacian of the line,
+    // defined consistently with the explicit Gaussian smoothing
+    const auto num_points = points.size();
+    const auto t = this->TimeStep;
+
+    lower.assign(num_points, -0.5 * t);
+    diagonal.assign(num_points, 1.0 + t);
+    upper.assign(num_points, -0.5 * t);
+
+    if (!closed || num_points < 3)
+    {
+        // End points only have a single neighbor; this also holds for closed lines consisting of two points
+        upper.front() = -t;
+        lower.back() = -t;
+
+        solve_tridiagonal(lower, diagonal, upper, points, scratch);
+    }
+    else
+    {
+        // Solve the cyclic system using the Sherman-Morrison formula, i.e., solve a tridiagonal system
+        // with modified diagonal, and correct the result by solving a second system
+        const auto alpha = upper.back();
+        const auto beta = lower.front();
+        const auto gamma = -diagonal.front();
+
+        diagonal.front() -= gamma;
+        diagonal.back() -= alpha * beta / gamma;
+
+        solve_tridiagonal(lower, diagonal, upper, points, scratch);
+
+        correction.assign(num_points, 0.0);
+        correction.front() = gamma;
+        correction.back() = alpha;
+
+        solve_tridiagonal(lower, diagonal, upper, correction, scratch);
+
+        const Eigen::Vector3d factor = (points.front() + (beta / gamma) * points.back())
+            / (1.0 + correction.front() + (beta / gamma) * correction.back());
+
+        for (std::size_t index = 0; index < num_points; ++index)
+        {
+            points[index] -= correction[index] * factor;
+        }
+    }
+}
+
+template <typename value_t>
+void smooth_lines::solve_tridiagonal(const std::vector<double>& lower, const std::vector<double>& diagonal,
+    const std::vector<double>& upper, std::vector<value_t>& values, std::vector<double>& scratch) const
+{
+    // Thomas algorithm: forward elimination, followed by back substitution
+    const auto num_values = values.size();
+
+    scratch.resize(num_values);
+
+    scratch[0] = upper[0] / diagonal[0];
+    values[0] = values[0] / diagonal[0];
+
+    for (std::size_t index = 1; index < num_values; ++index)
+    {
+        const auto denominator = diagonal[index] - lower[index] * scratch[index - 1];
+
+        scratch[index] = upper[index] / denominator;
+        values[index] = (values[index] - lower[index] * values[index - 1]) / denominator;
+    }
+
+    for (std::size_t index = num_values - 1; index > 0; --index)
+    {
+        values[index - 1] = values[index - 1] - scratch[index - 1] * values[index];
+    }
+}
+
+void smooth_lines::smooth_shared_points(vtkPolyData* input, vtkPoints* smoothed_points, vtkIntArray* iterations, vtkDoubleArray* residuals) const
+{
+    const auto num_points = input->GetNumberOfPoints();
+
+    // Create adjacency graph in compressed sparse row format, where each segment adds an edge in both directions
+    std::vector<vtkIdType> offsets(num_points + 1, 0);
+
+    auto point_indices = vtkSmartPointer<vtkIdList>::New();
+
+    input->GetLines()->InitTraversal();
+
+    while (input->GetLines()->GetNextCell(point_indices))
+    {
+        for (vtkIdType index = 0; index < point_indices->GetNumberOfIds() - 1; ++index)
+        {
+            if (point_indices->GetId(index) != point_indices->GetId(index + 1))
+            {
+                ++offsets[point_indices->GetId(index) + 1];
+                ++offsets[point_indices->GetId(index + 1) + 1];
+            }
         }
+    }
+
+    std::partial_sum(offsets.begin(), offsets.end(), offsets.begin());
 
-        // Apply Taubin smoothing
-        for (std::size_t i = 0; i < this->NumIterations; ++i)
+    std::vector<vtkIdType> neighbors(offsets.back());
+    std::vector<vtkIdType> insert_positions(offsets.begin(), offsets.end() - 1);
+
+    input->GetLines()->InitTraversal();
+
+    while (input->GetLines()->GetNextCell(point_indices))
+    {
+        for (vtkIdType index = 0; index < point_indices->GetNumberOfIds() - 1; ++index)
         {
-            for (std::size_t index = 0; index < points.size(); ++index)
+            const auto point_index = point_indices->GetId(index);
+            const auto next_point_index = point_indices->GetId(index + 1);
+
+            if (point_index != next_point_index)
             {
-                temp_points[index] = gaussian_smoothing(points, index, this->Lambda);
+                neighbors[insert_positions[point_index]++] = next_point_index;
+                neighbors[insert_positions[next_point_index]++] = point_index;
             }
+        }
+    }
+
+    // Remove duplicate edges from segments shared by more than one line
+    vtkIdType num_neighbors = 0;
+
+    for (vtkIdType point_index = 0; point_index < num_points; ++point_index)
+    {
+        const auto first = neighbors.begin() + offsets[point_index];
+        const auto last = neighbors.begin() + offsets[point_index + 1];
+
+        std::sort(first, last);
+
+        offsets[point_index] = num_neighbors;
+        num_neighbors = std::copy(first, std::unique(first, last), neighbors.begin() + num_neighbors) - neighbors.begin();
+    }
+
+    offsets[num_points] = num_neighbors;
+
+    // Get points
+    std::vector<Eigen::Vector3d> points(num_points), temp_points(num_points);
 
-            for (std::size_t index = 0; index < points.size(); ++index)
+    for (vtkIdType point_index = 0; point_index < num_points; ++point_index)
+    {
+        input->GetPoints()->GetPoint(point_index, points[point_index].data());
+    }
+
+    // Apply Taubin smoothing in parallel over all points, until the maximum displacement falls below the tolerance, if requested
+    std::vector<double> displacements(num_points, 0.0);
+
+    auto smooth = [&offsets, &neighbors](const std::vector<Eigen::Vector3d>& source, std::vector<Eigen::Vector3d>& target, const double weight)
+    {
+        auto smooth_range = [&](const vtkIdType begin, const vtkIdType end)
+        {
+            for (vtkIdType point_index = begin; point_index < end; ++point_index)
+            {
+                target[point_index] = source[point_index];
+
+                if (offsets[point_index] != offsets[point_index + 1])
+                {
+                    Eigen::Vector3d average{ 0.0, 0.0, 0.0 };
+
+                    for (auto neighbor = offsets[point_index]; neighbor < offsets[point_index + 1]; ++neighbor)
+                    {
+                        average += source[neighbors[neighbor]];
+                    }
+
+                    average /= static_cast<double>(offsets[point_index + 1] - offsets[point_index]);
+
+                    target[point_index] += weight * (average - source[point_index]);
+                }
+            }
+        };
+
+        vtkSMPTools::For(0, static_cast<vtkIdType>(source.size()), smooth_range);
+    };
+
+    std::vector<Eigen::Vector3d> smoothed(num_points);
+
+    auto compute_displacements = [&points, &smoothed, &displacements]() -> double
+    {
+        vtkSMPThreadLocal<double> local_max_displacement(0.0);
+
+        auto compute_range = [&](const vtkIdType begin, const vtkIdType end)
+        {
+            auto& max_displacement = local_max_displacement.Local();
+
+            for (vtkIdType point_index = begin; point_index < end; ++point_index)
             {
-                points[index] = gaussian_smoothing(temp_points, index, this->Mu);
+                displacements[point_index] = (smoothed[point_index] - points[point_index]).squaredNorm();
+                max_displacement = std::max(max_displacement, displacements[point_index]);
             }
+        };
+
+        vtkSMPTools::For(0, static_cast<vtkIdType>(points.size()), compute_range);
+
+        double max_displacement = 0.0;
+
+        for (const auto thread_max_displacement : local_max_displacement)
+        {
+            max_displacement = std::max(max_displacement, thread_max_displacement);
         }
 
-        // Write smoothed points to output
+        return max_displacement;
+    };
+
+    int num_iterations = 0;
+    double max_displacement = 0.0;
+
+    for (; num_iterations < this->NumIterations && !converged(max_displacement, num_iterations); ++num_iterations)
+    {
+        smooth(points, temp_points, this->Lambda);
+        smooth(temp_points, smoothed, this->Mu);
+
+        max_displacement = compute_displacements();
+
+        std::swap(points, smoothed);
+    }
+
+    // Set number of iterations and the residual, i.e., the maximum displacement of the points of each line
+    input->GetLines()->InitTraversal();
+
+    for (vtkIdType cell_index = input->GetNumberOfVerts(); input->GetLines()->GetNextCell(point_indices); ++cell_index)
+    {
+        double line_displacement = 0.0;
+
         for (vtkIdType index = 0; index < point_indices->GetNumberOfIds(); ++index)
         {
-            output->GetPoints()->SetPoint(point_indices->GetId(index), points[index].data());
+            line_displacement = std::max(line_displacement, displacements[point_indices->GetId(index)]);
         }
+
+        iterations->SetValue(cell_index, num_iterations);
+        residuals->SetValue(cell_index, std::sqrt(line_displacement));
     }
 
-    return 1;
+    // Write smoothed points to output
+    for (vtkIdType point_index = 0; point_index < num_points; ++point_index)
+    {
+        if (offsets[point_index] != offsets[point_index + 1])
+        {
+            smoothed_points->SetPoint(point_index, points[point_index].data());
+        }
+    }
+}
+
+bool smooth_lines::converged(const double max_displacement, const int num_iterations) const
+{
+    return this->Convergence && num_iterations > 0 && max_displacement < this->Tolerance * this->Tolerance;
 }
 
-Eigen::Vector3d smooth_lines::gaussian_smoothing(const std::vector<Eigen::Vector3d>& points, const std::size_t index, const double weight) const
+Eigen::Vector3d smooth_lines::gaussian_smoothing(const std::vector<Eigen::Vector3d>& points, const std::size_t index, const double weight, const bool closed) const
 {
     auto point = points[index];
 
-    if (index == 0)
+    if (points.size() < 2)
+    {
+        return point;
+    }
+
+    if (closed)
+    {
+        const auto& previous = points[(index + points.size() - 1) % points.size()];
+        const auto& next = points[(index + 1) % points.size()];
+
+        point = point + weight * (
+            0.5 * (previous - point) +
+            0.5 * (next - point));
+    }
+    else if (index == 0)
     {
         point = point + weight * (points[index + 1] - point);
     }
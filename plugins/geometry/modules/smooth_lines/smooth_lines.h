@@ -1,11 +1,17 @@
 #pragma once
 
 #include "vtkInformation.h"
+#include "vtkDoubleArray.h"
 #include "vtkInformationVector.h"
+#include "vtkIntArray.h"
+#include "vtkPoints.h"
+#include "vtkPolyData.h"
 #include "vtkPolyDataAlgorithm.h"
 
 #include "Eigen/Dense"
 
+#include <vector>
+
 class smooth_lines : public vtkPolyDataAlgorithm
 {
 public:
@@ -21,6 +27,21 @@ public:
     vtkSetMacro(Mu, double);
     vtkGetMacro(Mu, double);
 
+    vtkSetMacro(Connectivity, int);
+    vtkGetMacro(Connectivity, int);
+
+    vtkSetMacro(Convergence, int);
+    vtkGetMacro(Convergence, int);
+
+    vtkSetMacro(Tolerance, double);
+    vtkGetMacro(Tolerance, double);
+
+    vtkSetMacro(Method, int);
+    vtkGetMacro(Method, int);
+
+    vtkSetMacro(TimeStep, double);
+    vtkGetMacro(TimeStep, double);
+
 protected:
     smooth_lines();
 
@@ -32,18 +53,84 @@ private:
     smooth_lines(const smooth_lines&);
     void operator=(const smooth_lines&);
 
+    /*
+     * Smooth each line independently of all other lines
+     *
+     * @param input Input lines
+     * @param smoothed_points Output points, initialized with the input point positions
+     * @param iterations Output number of iterations performed per cell
+     * @param residuals Output maximum point displacement in the last iteration per cell
+     */
+    void smooth_line_wise(vtkPolyData* input, vtkPoints* smoothed_points, vtkIntArray* iterations, vtkDoubleArray* residuals) const;
+
+    /*
+     * Smooth all lines at once on the graph defined by the points and their connecting segments
+     *
+     * @param input Input lines
+     * @param smoothed_points Output points, initialized with the input point positions
+     * @param iterations Output number of iterations performed per cell
+     * @param residuals Output maximum point displacement in the last iteration per cell
+     */
+    void smooth_shared_points(vtkPolyData* input, vtkPoints* smoothed_points, vtkIntArray* iterations, vtkDoubleArray* residuals) const;
+
+    /*
+     * Implicit smoothing of a line using a single backward Euler step
+     *
+     * @param points Line points, which are replaced by the smoothed points
+     * @param closed Line is a closed loop, whose first point is the successor of its last point
+     * @param lower Buffer for the subdiagonal of the system matrix
+     * @param diagonal Buffer for the diagonal of the system matrix
+     * @param upper Buffer for the superdiagonal of the system matrix
+     * @param scratch Buffer for the tridiagonal solver
+     * @param correction Buffer for the correction of cyclic systems
+     */
+    void implicit_smoothing(std::vector<Eigen::Vector3d>& points, bool closed, std::vector<double>& lower,
+        std::vector<double>& diagonal, std::vector<double>& upper, std::vector<double>& scratch, std::vector<double>& correction) const;
+
+    /*
+     * Solve a tridiagonal system of equations using the Thomas algorithm
+     *
+     * @param lower Subdiagonal, where the first entry is ignored
+     * @param diagonal Diagonal
+     * @param upper Superdiagonal, where the last entry is ignored
+     * @param values Right-hand side, which is replaced by the solution
+     * @param scratch Buffer for the modified superdiagonal
+     */
+    template <typename value_t>
+    void solve_tridiagonal(const std::vector<double>& lower, const std::vector<double>& diagonal,
+        const std::vector<double>& upper, std::vector<value_t>& values, std::vector<double>& scratch) const;
+
+    /*
+     * Check for convergence, if requested
+     *
+     * @param max_displacement Maximum squared displacement of a point in the last iteration
+     * @param num_iterations Number of iterations already performed
+     *
+     * @return True if the smoothing converged and can be stopped
+     */
+    bool converged(double max_displacement, int num_iterations) const;
+
     /*
      * Gaussian smoothing
      *
      * @param points Line points
      * @param index Index of the point for which the displacement from smoothing is calculated
      * @param weight Smoothing weight; positive for smoothing, negative for inflation
+     * @param closed Line is a closed loop, whose first point is the successor of its last point
      *
      * @return Displaced point
      */
-    Eigen::Vector3d gaussian_smoothing(const std::vector<Eigen::Vector3d>& points, std::size_t index, double weight) const;
+    Eigen::Vector3d gaussian_smoothing(const std::vector<Eigen::Vector3d>& points, std::size_t index, double weight, bool closed) const;
 
     /// Parameters
     int NumIterations;
     double Lambda, Mu;
+
+    int Connectivity;
+
+    int Convergence;
+    double Tolerance;
+
+    int Method;
+    double TimeStep;
 };
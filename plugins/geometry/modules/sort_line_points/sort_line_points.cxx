@@ -1,21 +1,29 @@
 #include "sort_line_points.h"
 
+#include "vtkCellArray.h"
 #include "vtkCellData.h"
+#include "vtkDataArray.h"
 #include "vtkDataObject.h"
+#include "vtkDataSetAttributes.h"
 #include "vtkIdList.h"
 #include "vtkIdTypeArray.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkObjectFactory.h"
 #include "vtkPointData.h"
+#include "vtkPoints.h"
 #include "vtkPolyData.h"
+#include "vtkSMPTools.h"
 #include "vtkSmartPointer.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
+#include "common/radix_sort.h"
+
 #include <algorithm>
 #include <array>
-#include <cmath>
-#include <map>
+#include <cstdint>
+#include <numeric>
+#include <utility>
 #include <vector>
 
 vtkStandardNewMacro(sort_line_points);
@@ -52,56 +60,190 @@ int sort_line_points::RequestData(vtkInformation*, vtkInformationVector** input_
     auto* out_info = output_vector->GetInformationObject(0);
     auto* output = vtkPolyData::SafeDownCast(out_info->Get(vtkDataObject::DATA_OBJECT()));
 
-    // Get lines and sort their points
-    input->GetLines()->InitTraversal();
-    auto point_ids = vtkSmartPointer<vtkIdList>::New();
+    // Output empty points and lines for empty input
+    if (input->GetPoints() == nullptr || input->GetNumberOfPoints() == 0 || input->GetLines() == nullptr)
+    {
+        output->SetPoints(vtkSmartPointer<vtkPoints>::New());
+        output->SetLines(vtkSmartPointer<vtkCellArray>::New());
+
+        return 1;
+    }
+
+    // Get lines, storing the position of each line in the connectivity array
+    auto input_cell_indices = input->GetLines()->GetData();
+    const auto* input_cell_index_values = input_cell_indices->GetPointer(0);
+
+    std::vector<vtkIdType> cell_offsets;
+    cell_offsets.reserve(input->GetLines()->GetNumberOfCells());
+
+    for (vtkIdType cell_index = 0; cell_index < input_cell_indices->GetNumberOfValues(); cell_index += input_cell_index_values[cell_index] + 1)
+    {
+        cell_offsets.push_back(cell_index);
+    }
+
+    const auto num_cells = static_cast<vtkIdType>(cell_offsets.size());
 
-    std::map<vtkIdType, vtkIdType> point_map;
-    vtkIdType new_index = 0;
+    // Sort points, using a dense map from old to new point indices, and its inverse
+    std::vector<vtkIdType> point_map(input->GetNumberOfPoints(), -1);
+    std::vector<vtkIdType> inverse_point_map;
 
-    while (input->GetLines()->GetNextCell(point_ids))
+    if (this->Ordering == 0)
     {
-        // Create point map
-        for (vtkIdType i = 0; i < point_ids->GetNumberOfIds(); ++i)
+        // The new index is given by the first occurrence of the point in the lines
+        inverse_point_map.reserve(input->GetNumberOfPoints());
+
+        for (vtkIdType cell_index = 0; cell_index < input_cell_indices->GetNumberOfValues();)
         {
-            if (point_map.find(point_ids->GetId(i)) == point_map.end())
+            const vtkIdType num_points = input_cell_index_values[cell_index++];
+
+            for (vtkIdType i = 0; i < num_points; ++i, ++cell_index)
             {
-                point_map[point_ids->GetId(i)] = new_index++;
+                auto& new_index = point_map[input_cell_index_values[cell_index]];
+
+                if (new_index == -1)
+                {
+                    new_index = static_cast<vtkIdType>(inverse_point_map.size());
+                    inverse_point_map.push_back(input_cell_index_values[cell_index]);
+                }
             }
         }
     }
+    else
+    {
+        // The new index is given by the position of the point along a space-filling curve
+        inverse_point_map = sort_along_curve(input->GetPoints(), this->Ordering == 2);
 
-    // Copy points to new position
-    auto points = vtkSmartPointer<vtkPoints>::New();
-    points->SetNumberOfPoints(point_map.size());
+        auto invert = [&point_map, &inverse_point_map](const vtkIdType begin, const vtkIdType end)
+        {
+            for (vtkIdType index = begin; index < end; ++index)
+            {
+                point_map[inverse_point_map[index]] = index;
+            }
+        };
+
+        vtkSMPTools::For(0, static_cast<vtkIdType>(inverse_point_map.size()), invert);
+    }
 
-    for (const auto indices : point_map)
+    // Sort cells by the new index of their first point, if requested
+    std::vector<vtkIdType> cell_order(num_cells);
+    std::iota(cell_order.begin(), cell_order.end(), 0);
+
+    if (this->Ordering != 0 && this->SortCells)
     {
-        const auto old_index = indices.first;
-        const auto new_index = indices.second;
+        std::vector<std::uint64_t> cell_keys(num_cells);
+
+        for (vtkIdType cell = 0; cell < num_cells; ++cell)
+        {
+            const auto cell_index = cell_offsets[cell];
+
+            cell_keys[cell] = (input_cell_index_values[cell_index] > 0)
+                ? static_cast<std::uint64_t>(point_map[input_cell_index_values[cell_index + 1]])
+                : static_cast<std::uint64_t>(input->GetNumberOfPoints());
+        }
+
+        int num_bits = 1;
 
-        std::array<double, 3> point;
-        input->GetPoint(old_index, point.data());
-        points->SetPoint(new_index, point.data());
+        while ((static_cast<std::uint64_t>(input->GetNumberOfPoints()) >> num_bits) != 0)
+        {
+            ++num_bits;
+        }
+
+        radix_sort(cell_keys, cell_order, num_bits);
     }
 
+    // Create output points and point data arrays, storing the pairs of input and output arrays for reordering
+    auto points = vtkSmartPointer<vtkPoints>::New();
+    points->SetDataType(input->GetPoints()->GetDataType());
+    points->SetNumberOfPoints(static_cast<vtkIdType>(inverse_point_map.size()));
+
     output->SetPoints(points);
 
-    // Create cells
-    auto cell_indices = input->GetLines()->GetData();
-    auto cell_index = 0;
-    auto num_cells = 0;
+    std::vector<std::pair<vtkDataArray*, vtkDataArray*>> arrays;
 
-    while (cell_index < cell_indices->GetNumberOfValues())
+    if (input->GetPoints()->GetData()->HasStandardMemoryLayout())
+    {
+        arrays.push_back(std::make_pair(input->GetPoints()->GetData(), points->GetData()));
+    }
+    else
     {
-        const vtkIdType num_points = cell_indices->GetValue(cell_index++);
+        // Coordinates without contiguous memory are copied serially, instead of accessing a temporary copy
+        for (std::size_t index = 0; index < inverse_point_map.size(); ++index)
+        {
+            points->GetData()->SetTuple(static_cast<vtkIdType>(index), inverse_point_map[index], input->GetPoints()->GetData());
+        }
+    }
+
+    for (int array_index = 0; array_index < input->GetPointData()->GetNumberOfArrays(); ++array_index)
+    {
+        auto* in_array = input->GetPointData()->GetAbstractArray(array_index);
+
+        vtkSmartPointer<vtkAbstractArray> out_array;
+        out_array.TakeReference(in_array->NewInstance());
+        out_array->SetNumberOfComponents(in_array->GetNumberOfComponents());
+        out_array->SetNumberOfTuples(static_cast<vtkIdType>(inverse_point_map.size()));
+        out_array->SetName(in_array->GetName());
+
+        if (vtkDataArray::SafeDownCast(in_array) != nullptr && in_array->HasStandardMemoryLayout() && in_array->GetDataType() != VTK_BIT)
+        {
+            arrays.push_back(std::make_pair(vtkDataArray::SafeDownCast(in_array), vtkDataArray::SafeDownCast(out_array)));
+        }
+        else
+        {
+            // Arrays without one value per component in contiguous memory, e.g., string and bit arrays, are copied serially
+            for (std::size_t index = 0; index < inverse_point_map.size(); ++index)
+            {
+                out_array->SetTuple(static_cast<vtkIdType>(index), inverse_point_map[index], in_array);
+            }
+        }
+
+        output->GetPointData()->AddArray(out_array);
+    }
+
+    // Set active attributes, e.g., scalars and vectors, as arrays are stored in the same order as in the input
+    int attribute_indices[vtkDataSetAttributes::NUM_ATTRIBUTES];
+    input->GetPointData()->GetAttributeIndices(attribute_indices);
+
+    for (int attribute = 0; attribute < vtkDataSetAttributes::NUM_ATTRIBUTES; ++attribute)
+    {
+        if (attribute_indices[attribute] >= 0)
+        {
+            output->GetPointData()->SetActiveAttribute(attribute_indices[attribute], attribute);
+        }
+    }
 
-        for (vtkIdType i = 0; i < num_points; ++i, ++cell_index)
+    // Copy points and point data to their new position in a single parallel pass
+    auto reorder = [&arrays, &inverse_point_map](const vtkIdType begin, const vtkIdType end)
+    {
+        for (const auto& array : arrays)
         {
-            cell_indices->SetValue(cell_index, point_map[cell_indices->GetValue(cell_index)]);
+            switch (array.first->GetDataType())
+            {
+                vtkTemplateMacro(gather(static_cast<VTK_TT*>(array.first->GetVoidPointer(0)), static_cast<VTK_TT*>(array.second->GetVoidPointer(0)),
+                    inverse_point_map.data(), begin, end, array.first->GetNumberOfComponents()));
+            }
         }
+    };
+
+    vtkSMPTools::For(0, static_cast<vtkIdType>(inverse_point_map.size()), reorder);
+
+    // Create cells, with connectivity referencing the new point indices
+    auto cell_indices = vtkSmartPointer<vtkIdTypeArray>::New();
+    cell_indices->SetNumberOfComponents(1);
+    cell_indices->SetNumberOfTuples(input_cell_indices->GetNumberOfValues());
+
+    auto* cell_index_values = cell_indices->GetPointer(0);
 
-        ++num_cells;
+    for (const auto cell : cell_order)
+    {
+        auto input_cell_index = cell_offsets[cell];
+
+        const vtkIdType num_points = input_cell_index_values[input_cell_index++];
+        *cell_index_values++ = num_points;
+
+        for (vtkIdType i = 0; i < num_points; ++i, ++input_cell_index)
+        {
+            *cell_index_values++ = point_map[input_cell_index_values[input_cell_index]];
+        }
     }
 
     auto cells = vtkSmartPointer<vtkCellArray>::New();
@@ -111,3 +253,150 @@ int sort_line_points::RequestData(vtkInformation*, vtkInformationVector** input_
 
     return 1;
 }
+
+std::vector<vtkIdType> sort_line_points::sort_along_curve(vtkPoints* points, const bool hilbert) const
+{
+    if (points == nullptr || points->GetNumberOfPoints() == 0)
+    {
+        return std::vector<vtkIdType>();
+    }
+
+    // Compute keys along the space-filling curve from coordinates, quantized within the bounding box
+    std::vector<std::uint64_t> keys(points->GetNumberOfPoints());
+
+    double bounds[6];
+    points->GetBounds(bounds);
+
+    if (points->GetData()->HasStandardMemoryLayout())
+    {
+        switch (points->GetDataType())
+        {
+            vtkTemplateMacro(compute_curve_keys(static_cast<const VTK_TT*>(points->GetData()->GetVoidPointer(0)), bounds, hilbert, keys));
+        }
+    }
+    else
+    {
+        std::vector<double> coordinates(3 * keys.size());
+
+        for (vtkIdType index = 0; index < points->GetNumberOfPoints(); ++index)
+        {
+            points->GetPoint(index, &coordinates[3 * index]);
+        }
+
+        compute_curve_keys(coordinates.data(), bounds, hilbert, keys);
+    }
+
+    // Sort point indices by their keys
+    std::vector<vtkIdType> indices(keys.size());
+    std::iota(indices.begin(), indices.end(), 0);
+
+    radix_sort(keys, indices, 3 * curve_bits);
+
+    return indices;
+}
+
+template <typename value_t>
+void sort_line_points::compute_curve_keys(const value_t* coordinates, const double* bounds, const bool hilbert, std::vector<std::uint64_t>& keys)
+{
+    constexpr std::uint32_t max_coordinate = (1u << curve_bits) - 1u;
+
+    std::array<double, 3> scale;
+
+    for (int d = 0; d < 3; ++d)
+    {
+        const auto extent = bounds[2 * d + 1] - bounds[2 * d];
+        scale[d] = (extent > 0.0) ? (max_coordinate / extent) : 0.0;
+    }
+
+    auto compute_keys = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType index = begin; index < end; ++index)
+        {
+            std::array<std::uint32_t, 3> quantized;
+
+            for (int d = 0; d < 3; ++d)
+            {
+                const auto value = (static_cast<double>(coordinates[index * 3 + d]) - bounds[2 * d]) * scale[d];
+                quantized[d] = static_cast<std::uint32_t>(std::min(std::max(value, 0.0), static_cast<double>(max_coordinate)));
+            }
+
+            keys[index] = hilbert ? hilbert_key(quantized) : morton_key(quantized);
+        }
+    };
+
+    vtkSMPTools::For(0, static_cast<vtkIdType>(keys.size()), compute_keys);
+}
+
+std::uint64_t sort_line_points::morton_key(const std::array<std::uint32_t, 3>& coordinates)
+{
+    // Spread bits, such that there are two zero bits between each of the original bits
+    auto spread = [](std::uint64_t value) -> std::uint64_t
+    {
+        value &= 0x1fffff;
+        value = (value | (value << 32)) & 0x1f00000000ffff;
+        value = (value | (value << 16)) & 0x1f0000ff0000ff;
+        value = (value | (value << 8)) & 0x100f00f00f00f00f;
+        value = (value | (value << 4)) & 0x10c30c30c30c30c3;
+        value = (value | (value << 2)) & 0x1249249249249249;
+
+        return value;
+    };
+
+    return (spread(coordinates[0]) << 2) | (spread(coordinates[1]) << 1) | spread(coordinates[2]);
+}
+
+std::uint64_t sort_line_points::hilbert_key(std::array<std::uint32_t, 3> coordinates)
+{
+    // Transform coordinates into the transposed Hilbert index (Skilling, 2004),
+    // whose bits are then interleaved in the same way as for the Morton order
+    constexpr std::uint32_t highest_bit = 1u << (curve_bits - 1);
+
+    for (auto q = highest_bit; q > 1; q >>= 1)
+    {
+        const auto p = q - 1;
+
+        for (int d = 0; d < 3; ++d)
+        {
+            if (coordinates[d] & q)
+            {
+                coordinates[0] ^= p;
+            }
+            else
+            {
+                const auto t = (coordinates[0] ^ coordinates[d]) & p;
+                coordinates[0] ^= t;
+                coordinates[d] ^= t;
+            }
+        }
+    }
+
+    coordinates[1] ^= coordinates[0];
+    coordinates[2] ^= coordinates[1];
+
+    std::uint32_t t = 0;
+
+    for (auto q = highest_bit; q > 1; q >>= 1)
+    {
+        if (coordinates[2] & q)
+        {
+            t ^= q - 1;
+        }
+    }
+
+    for (int d = 0; d < 3; ++d)
+    {
+        coordinates[d] ^= t;
+    }
+
+    return morton_key(coordinates);
+}
+
+template <typename value_t>
+void sort_line_points::gather(const value_t* input, value_t* output, const vtkIdType* indices,
+    const vtkIdType begin, const vtkIdType end, const int num_components)
+{
+    for (vtkIdType index = begin; index < end; ++index)
+    {
+        std::copy_n(input + indices[index] * num_components, num_components, output + index * num_components);
+    }
+}
@@ -2,14 +2,25 @@
 
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
+#include "vtkPoints.h"
 #include "vtkPolyDataAlgorithm.h"
 
+#include <array>
+#include <cstdint>
+#include <vector>
+
 class sort_line_points : public vtkPolyDataAlgorithm
 {
 public:
     static sort_line_points *New();
     vtkTypeMacro(sort_line_points, vtkPolyDataAlgorithm);
 
+    vtkSetMacro(Ordering, int);
+    vtkGetMacro(Ordering, int);
+
+    vtkSetMacro(SortCells, int);
+    vtkGetMacro(SortCells, int);
+
 protected:
     sort_line_points();
 
@@ -20,4 +31,51 @@ protected:
 private:
     sort_line_points(const sort_line_points&);
     void operator=(const sort_line_points&);
+
+    /// Number of bits per coordinate for computing keys along a space-filling curve
+    static constexpr int curve_bits = 21;
+
+    /*
+     * Sort points along a space-filling curve
+     *
+     * @param points Input points
+     * @param hilbert Use the Hilbert curve instead of the Morton order (Z-order curve)
+     *
+     * @return Indices of the input points, in the order along the curve
+     */
+    std::vector<vtkIdType> sort_along_curve(vtkPoints* points, bool hilbert) const;
+
+    /*
+     * Compute keys along a space-filling curve in parallel
+     *
+     * @param coordinates Point coordinates
+     * @param bounds Bounding box of the points
+     * @param hilbert Use the Hilbert curve instead of the Morton order (Z-order curve)
+     * @param keys Output keys, allocated for all points
+     */
+    template <typename value_t>
+    static void compute_curve_keys(const value_t* coordinates, const double* bounds, bool hilbert, std::vector<std::uint64_t>& keys);
+
+    /// Compute key along the Morton order (Z-order curve) from quantized coordinates
+    static std::uint64_t morton_key(const std::array<std::uint32_t, 3>& coordinates);
+
+    /// Compute key along the Hilbert curve from quantized coordinates
+    static std::uint64_t hilbert_key(std::array<std::uint32_t, 3> coordinates);
+
+    /*
+     * Gather tuples of an array in the given range, such that output[i] = input[indices[i]]
+     *
+     * @param input Input values
+     * @param output Output values, allocated for all indices
+     * @param indices Indices of the input tuples, in the order they are stored in the output
+     * @param begin First output tuple
+     * @param end One past the last output tuple
+     * @param num_components Number of components per tuple
+     */
+    template <typename value_t>
+    static void gather(const value_t* input, value_t* output, const vtkIdType* indices, vtkIdType begin, vtkIdType end, int num_components);
+
+    /// Parameters
+    int Ordering;
+    int SortCells;
 };
@@ -2,19 +2,27 @@
 
 #include "vtkCellData.h"
 #include "vtkDataObject.h"
-#include "vtkIdList.h"
 #include "vtkIdTypeArray.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkObjectFactory.h"
 #include "vtkPointData.h"
+#include "vtkPoints.h"
 #include "vtkPolyData.h"
+#include "vtkSMPThreadLocal.h"
+#include "vtkSMPTools.h"
 #include "vtkSmartPointer.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
+#include "common/line_cells.h"
+#include "common/line_data.h"
+#include "common/prefix_sum.h"
+
+#include <algorithm>
 #include <array>
+#include <cmath>
 #include <iostream>
-#include <unordered_set>
+#include <utility>
 #include <vector>
 
 vtkStandardNewMacro(truncate_lines);
@@ -52,72 +60,316 @@ int truncate_lines::RequestData(vtkInformation*, vtkInformationVector** input_ve
     auto* output = vtkPolyData::SafeDownCast(out_info->Get(vtkDataObject::DATA_OBJECT()));
 
     // Check parameters
-    if (this->Offset < 0)
+    if (this->Method == 0 && this->Offset < 0)
     {
         std::cerr << "Offset must not be negative" << std::endl;
         return 0;
     }
 
-    if (this->NumPoints < 0)
+    if (this->Method == 0 && this->NumPoints < 0)
     {
         std::cerr << "Number of points must not be negative" << std::endl;
         return 0;
     }
 
-    // Get lines and truncate them
-    std::vector<std::vector<vtkIdType>> lines;
+    if (this->Method != 0 && this->Range[0] > this->Range[1])
+    {
+        std::cerr << "Start of the range must not be larger than its end" << std::endl;
+        return 0;
+    }
+
+    // Get lines
+    const line_view lines(input->GetLines());
 
-    std::size_t num_points = 0;
+    // Truncate lines
+    std::vector<vtkIdType> source_lines;
 
-    if (this->NumPoints > 0)
+    if (this->Method == 0)
+    {
+        source_lines = truncate_by_index(input, output, lines);
+    }
+    else if (input->GetPoints() != nullptr && input->GetPoints()->GetData()->HasStandardMemoryLayout())
     {
-        input->GetLines()->InitTraversal();
+        switch (input->GetPoints()->GetDataType())
+        {
+            vtkTemplateMacro(source_lines = truncate_by_length(static_cast<const VTK_TT*>(input->GetPoints()->GetData()->GetVoidPointer(0)),
+                input, output, lines));
+        }
+    }
+    else if (input->GetPoints() != nullptr)
+    {
+        // Convert coordinates without contiguous memory explicitly, instead of accessing a temporary copy
+        std::vector<double> coordinates(3 * input->GetNumberOfPoints());
+
+        for (vtkIdType index = 0; index < input->GetNumberOfPoints(); ++index)
+        {
+            input->GetPoint(index, &coordinates[3 * index]);
+        }
+
+        source_lines = truncate_by_length(coordinates.data(), input, output, lines);
+    }
+
+    // Copy cell data from the source lines
+    copy_line_data(input, output, source_lines.data());
+
+    return 1;
+}
+
+std::vector<vtkIdType> truncate_lines::truncate_by_index(vtkPolyData* input, vtkPolyData* output, const line_view& lines) const
+{
+    const auto num_lines = lines.size();
 
-        auto point_ids = vtkSmartPointer<vtkIdList>::New();
+    // Find truncated lines, and compute output positions
+    std::vector<vtkIdType> cell_offsets(num_lines + 1, 0);
 
-        while (input->GetLines()->GetNextCell(point_ids))
+    auto count_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
         {
-            const auto size = point_ids->GetNumberOfIds();
+            cell_offsets[line_index + 1] = (this->NumPoints > 0 && this->Offset < lines.size(line_index)) ? 1 : 0;
+        }
+    };
+
+    vtkSMPTools::For(0, num_lines, count_range);
 
-            if (this->Offset < size)
+    prefix_sum(cell_offsets);
+
+    // Create cells
+    line_builder output_lines(cell_offsets[num_lines]);
+    std::vector<vtkIdType> source_lines(cell_offsets[num_lines]);
+
+    auto size_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
+        {
+            if (cell_offsets[line_index + 1] != cell_offsets[line_index])
             {
-                lines.emplace_back();
+                output_lines.set_size(cell_offsets[line_index], std::min(static_cast<vtkIdType>(this->NumPoints), lines.size(line_index) - this->Offset));
+                source_lines[cell_offsets[line_index]] = line_index;
+            }
+        }
+    };
+
+    vtkSMPTools::For(0, num_lines, size_range);
+
+    output_lines.allocate();
 
-                for (vtkIdType i = std::max(0, this->Offset); i < std::max(0, this->Offset) + this->NumPoints && i < point_ids->GetNumberOfIds(); ++i)
-                {
-                    lines.back().push_back(point_ids->GetId(i));
-                }
+    auto write_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
+        {
+            if (cell_offsets[line_index + 1] != cell_offsets[line_index])
+            {
+                const auto* line = lines.begin(line_index) + this->Offset;
 
-                num_points += lines.back().size();
+                std::copy(line, line + output_lines.size(cell_offsets[line_index]), output_lines.begin(cell_offsets[line_index]));
             }
         }
-    }
+    };
 
-    // Create cells
-    auto cell_ids = vtkSmartPointer<vtkIdTypeArray>::New();
-    cell_ids->SetNumberOfComponents(1);
-    cell_ids->Allocate(static_cast<vtkIdType>(lines.size() + num_points));
+    vtkSMPTools::For(0, num_lines, write_range);
+
+    output->SetLines(output_lines.build());
+
+    // Copy points and point data, as the points are unchanged
+    auto points = vtkSmartPointer<vtkPoints>::New();
+    points->ShallowCopy(input->GetPoints());
+
+    output->SetPoints(points);
+    output->GetPointData()->ShallowCopy(input->GetPointData());
 
-    for (const auto& line : lines)
+    return source_lines;
+}
+
+template <typename value_t>
+std::vector<vtkIdType> truncate_lines::truncate_by_length(const value_t* coordinates, vtkPolyData* input, vtkPolyData* output,
+    const line_view& lines) const
+{
+    const auto num_lines = lines.size();
+
+    // Find the start and end of the truncated lines, which are either existing points or new points on a segment
+    struct range_t
+    {
+        vtkIdType num_points;
+        vtkIdType first_point, last_point;
+        vtkIdType start_segment, end_segment;
+        double start_t, end_t;
+        bool new_start, new_end;
+    };
+
+    std::vector<range_t> ranges(num_lines);
+    std::vector<vtkIdType> cell_offsets(num_lines + 1, 0);
+    std::vector<vtkIdType> new_point_offsets(num_lines + 1, 0);
+
+    vtkSMPThreadLocal<std::vector<double>> local_arc_lengths;
+
+    auto find_range = [&](const vtkIdType begin, const vtkIdType end)
     {
-        cell_ids->InsertNextValue(static_cast<vtkIdType>(line.size()));
+        auto& arc_lengths = local_arc_lengths.Local();
 
-        for (const auto point_id : line)
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
         {
-            cell_ids->InsertNextValue(point_id);
+            const auto* line = lines.begin(line_index);
+            const auto num_points = lines.size(line_index);
+
+            if (num_points < 2)
+            {
+                continue;
+            }
+
+            // Compute arc length at each point
+            arc_lengths.resize(num_points);
+            arc_lengths[0] = 0.0;
+
+            for (vtkIdType i = 1; i < num_points; ++i)
+            {
+                const auto* point_1 = coordinates + 3 * line[i - 1];
+                const auto* point_2 = coordinates + 3 * line[i];
+
+                const auto dx = static_cast<double>(point_2[0]) - static_cast<double>(point_1[0]);
+                const auto dy = static_cast<double>(point_2[1]) - static_cast<double>(point_1[1]);
+                const auto dz = static_cast<double>(point_2[2]) - static_cast<double>(point_1[2]);
+
+                arc_lengths[i] = arc_lengths[i - 1] + std::sqrt(dx * dx + dy * dy + dz * dz);
+            }
+
+            // Get range in terms of arc length, restricted to the line
+            const auto total_length = arc_lengths[num_points - 1];
+            const auto scale = (this->Method == 2) ? total_length : 1.0;
+
+            const auto start = std::max(this->Range[0] * scale, 0.0);
+            const auto end = std::min(this->Range[1] * scale, total_length);
+
+            if (!(start < end))
+            {
+                continue;
+            }
+
+            // Find segments containing the start and end of the range
+            auto& range = ranges[line_index];
+
+            range.start_segment = static_cast<vtkIdType>(std::upper_bound(arc_lengths.begin(), arc_lengths.end(), start) - arc_lengths.begin()) - 1;
+            range.end_segment = static_cast<vtkIdType>(std::lower_bound(arc_lengths.begin(), arc_lengths.end(), end) - arc_lengths.begin()) - 1;
+
+            range.start_t = (start - arc_lengths[range.start_segment]) / (arc_lengths[range.start_segment + 1] - arc_lengths[range.start_segment]);
+            range.end_t = (end - arc_lengths[range.end_segment]) / (arc_lengths[range.end_segment + 1] - arc_lengths[range.end_segment]);
+
+            range.new_start = range.start_t > 0.0;
+            range.new_end = range.end_t < 1.0;
+
+            range.first_point = range.start_segment + (range.new_start ? 1 : 0);
+            range.last_point = range.end_segment + (range.new_end ? 0 : 1);
+
+            const auto num_new_points = (range.new_start ? 1 : 0) + (range.new_end ? 1 : 0);
+
+            range.num_points = num_new_points + range.last_point - range.first_point + 1;
+
+            cell_offsets[line_index + 1] = 1;
+            new_point_offsets[line_index + 1] = num_new_points;
         }
-    }
+    };
+
+    vtkSMPTools::For(0, num_lines, find_range);
+
+    prefix_sum(cell_offsets);
+    prefix_sum(new_point_offsets);
+
+    // Create cells, storing the segment and interpolation parameter of new points
+    const auto num_input_points = input->GetNumberOfPoints();
+    const auto num_new_points = new_point_offsets[num_lines];
 
-    auto cells = vtkSmartPointer<vtkCellArray>::New();
-    cells->SetCells(static_cast<vtkIdType>(lines.size()), cell_ids);
+    line_builder output_lines(cell_offsets[num_lines]);
 
-    output->SetLines(cells);
+    std::vector<vtkIdType> source_lines(cell_offsets[num_lines]);
+    std::vector<std::array<vtkIdType, 2>> new_point_segments(num_new_points);
+    std::vector<double> new_point_weights(num_new_points);
 
-    // Copy points
+    auto size_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
+        {
+            if (cell_offsets[line_index + 1] != cell_offsets[line_index])
+            {
+                output_lines.set_size(cell_offsets[line_index], ranges[line_index].num_points);
+                source_lines[cell_offsets[line_index]] = line_index;
+            }
+        }
+    };
+
+    vtkSMPTools::For(0, num_lines, size_range);
+
+    output_lines.allocate();
+
+    auto write_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
+        {
+            if (cell_offsets[line_index + 1] == cell_offsets[line_index])
+            {
+                continue;
+            }
+
+            const auto* line = lines.begin(line_index);
+            const auto& range = ranges[line_index];
+
+            auto* output_values = output_lines.begin(cell_offsets[line_index]);
+            auto new_point_index = new_point_offsets[line_index];
+
+            if (range.new_start)
+            {
+                new_point_segments[new_point_index] = { line[range.start_segment], line[range.start_segment + 1] };
+                new_point_weights[new_point_index] = range.start_t;
+
+                *output_values++ = num_input_points + new_point_index++;
+            }
+
+            output_values = std::copy(line + range.first_point, line + range.last_point + 1, output_values);
+
+            if (range.new_end)
+            {
+                new_point_segments[new_point_index] = { line[range.end_segment], line[range.end_segment + 1] };
+                new_point_weights[new_point_index] = range.end_t;
+
+                *output_values++ = num_input_points + new_point_index++;
+            }
+        }
+    };
+
+    vtkSMPTools::For(0, num_lines, write_range);
+
+    output->SetLines(output_lines.build());
+
+    // Create points and point data, appending the new points by interpolating along their segment
     auto points = vtkSmartPointer<vtkPoints>::New();
-    points->ShallowCopy(input->GetPoints());
+    points->DeepCopy(input->GetPoints());
+    points->SetNumberOfPoints(num_input_points + num_new_points);
 
     output->SetPoints(points);
+    output->GetPointData()->DeepCopy(input->GetPointData());
 
-    return 1;
+    std::vector<std::pair<vtkAbstractArray*, vtkAbstractArray*>> arrays;
+    arrays.push_back(std::make_pair(input->GetPoints()->GetData(), points->GetData()));
+
+    for (int array_index = 0; array_index < output->GetPointData()->GetNumberOfArrays(); ++array_index)
+    {
+        auto* out_array = output->GetPointData()->GetAbstractArray(array_index);
+        out_array->SetNumberOfTuples(num_input_points + num_new_points);
+
+        arrays.push_back(std::make_pair(input->GetPointData()->GetAbstractArray(array_index), out_array));
+    }
+
+    // Interpolate serially, as InterpolateTuple is not safe to call concurrently on the same array;
+    // there are at most two new points per line
+    for (vtkIdType new_point_index = 0; new_point_index < num_new_points; ++new_point_index)
+    {
+        const auto& segment = new_point_segments[new_point_index];
+
+        for (const auto& array : arrays)
+        {
+            array.second->InterpolateTuple(num_input_points + new_point_index,
+                segment[0], array.first, segment[1], array.first, new_point_weights[new_point_index]);
+        }
+    }
+
+    return source_lines;
 }
@@ -2,20 +2,31 @@
 
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
+#include "vtkPolyData.h"
 #include "vtkPolyDataAlgorithm.h"
 
+#include <vector>
+
+class line_view;
+
 class truncate_lines : public vtkPolyDataAlgorithm
 {
 public:
     static truncate_lines *New();
     vtkTypeMacro(truncate_lines, vtkPolyDataAlgorithm);
 
+    vtkSetMacro(Method, int);
+    vtkGetMacro(Method, int);
+
     vtkSetMacro(Offset, int);
     vtkGetMacro(Offset, int);
 
     vtkSetMacro(NumPoints, int);
     vtkGetMacro(NumPoints, int);
 
+    vtkSetVector2Macro(Range, double);
+    vtkGetVector2Macro(Range, double);
+
 protected:
     truncate_lines();
 
@@ -27,7 +38,34 @@ private:
     truncate_lines(const truncate_lines&);
     void operator=(const truncate_lines&);
 
+    /*
+     * Truncate lines by an offset and a maximum number of points, keeping the points unchanged
+     *
+     * @param input Input poly data
+     * @param output Output poly data, for which lines, points and point data are set
+     * @param lines Input lines
+     *
+     * @return Index of the source line for each output line
+     */
+    std::vector<vtkIdType> truncate_by_index(vtkPolyData* input, vtkPolyData* output, const line_view& lines) const;
+
+    /*
+     * Truncate lines by an arc length or parametric range, inserting interpolated points at the new endpoints
+     *
+     * @param coordinates Point coordinates
+     * @param input Input poly data
+     * @param output Output poly data, for which lines, points and point data are set
+     * @param lines Input lines
+     *
+     * @return Index of the source line for each output line
+     */
+    template <typename value_t>
+    std::vector<vtkIdType> truncate_by_length(const value_t* coordinates, vtkPolyData* input, vtkPolyData* output,
+        const line_view& lines) const;
+
     /// Parameters
+    int Method;
     int Offset;
     int NumPoints;
+    double Range[2];
 };
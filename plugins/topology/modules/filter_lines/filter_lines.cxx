@@ -1,18 +1,18 @@
 #include "filter_lines.h"
 
+#include "common/line_cells.h"
 #include "common/math.h"
 
 #include "vtkCellArray.h"
 #include "vtkDataObject.h"
 #include "vtkDoubleArray.h"
-#include "vtkIdList.h"
-#include "vtkIdTypeArray.h"
 #include "vtkInformation.h"
 #include "vtkInformationVector.h"
 #include "vtkObjectFactory.h"
 #include "vtkPointData.h"
 #include "vtkPoints.h"
 #include "vtkPolyData.h"
+#include "vtkSMPTools.h"
 #include "vtkSmartPointer.h"
 #include "vtkStreamingDemandDrivenPipeline.h"
 
@@ -20,7 +20,9 @@
 
 #include <algorithm>
 #include <cmath>
+#include <functional>
 #include <iostream>
+#include <numeric>
 #include <utility>
 #include <vector>
 
@@ -54,21 +56,8 @@ int filter_lines::RequestData(vtkInformation*, vtkInformationVector** input_vect
     auto* in_info = input_vector[0]->GetInformationObject(0);
     auto* input = vtkPolyData::SafeDownCast(in_info->Get(vtkDataObject::DATA_OBJECT()));
 
-    std::vector<std::vector<vtkIdType>> lines(input->GetLines()->GetNumberOfCells());
-
-    input->GetLines()->InitTraversal();
-    for (auto& line : lines)
-    {
-        auto point_ids = vtkSmartPointer<vtkIdList>::New();
-        input->GetLines()->GetNextCell(point_ids);
-
-        line.resize(point_ids->GetNumberOfIds());
-
-        for (std::size_t p = 0; p < line.size(); ++p)
-        {
-            line[p] = point_ids->GetId(p);
-        }
-    }
+    const line_view lines(input->GetLines());
+    const auto num_lines = lines.size();
 
     // Check parameters
     if (this->MaxAngle < 0.0 || this->MaxAngle > 180.0)
@@ -83,7 +72,9 @@ int filter_lines::RequestData(vtkInformation*, vtkInformationVector** input_vect
         return 0;
     }
 
-    // Filter by angle
+    // Filter by angle, marking segments that break the lines
+    std::vector<unsigned char> breaks(lines.storage_size(), 0);
+
     if (this->AngleFilter)
     {
         auto vectors = this->GetInputArrayToProcess(0, &input_vector[0]);
@@ -108,89 +99,116 @@ int filter_lines::RequestData(vtkInformation*, vtkInformationVector** input_vect
 
         const auto angle = pi * this->MaxAngle / 180.0;
 
-        std::vector<std::vector<vtkIdType>> filtered_lines;
-        filtered_lines.reserve(lines.size());
-
-        for (const auto& line : lines)
+        auto mark_range = [&](const vtkIdType begin, const vtkIdType end)
         {
-            filtered_lines.emplace_back();
-            filtered_lines.back().reserve(line.size());
-
-            // Look at each segment and calculate the angle
-            for (std::size_t p = 0; p < line.size() - 1; ++p)
+            for (vtkIdType line_index = begin; line_index < end; ++line_index)
             {
-                Eigen::Vector3d origin, target, vector;
+                const auto* line = lines.begin(line_index);
+                auto* line_breaks = breaks.data() + lines.offset(line_index);
 
-                input->GetPoint(line[p], origin.data());
-                input->GetPoint(line[p + 1], target.data());
-                vectors->GetTuple(line[p], vector.data());
+                // Look at each segment and calculate the angle
+                for (vtkIdType p = 0; p < lines.size(line_index) - 1; ++p)
+                {
+                    Eigen::Vector3d origin, target, vector;
 
-                const auto angle_1 = std::acos(vector.normalized().dot((target - origin).normalized()));
-                const auto angle_2 = std::acos(vector.normalized().dot((origin - target).normalized()));
+                    input->GetPoint(line[p], origin.data());
+                    input->GetPoint(line[p + 1], target.data());
+                    vectors->GetTuple(line[p], vector.data());
 
-                if (std::min(angle_1, angle_2) < angle)
-                {
-                    // Add point to line
-                    filtered_lines.back().push_back(line[p]);
-                }
-                else if (!filtered_lines.back().empty())
-                {
-                    // Start next line
-                    filtered_lines.emplace_back();
-                    filtered_lines.back().reserve(line.size() - p);
+                    const auto angle_1 = std::acos(vector.normalized().dot((target - origin).normalized()));
+                    const auto angle_2 = std::acos(vector.normalized().dot((origin - target).normalized()));
+
+                    line_breaks[p] = !(std::min(angle_1, angle_2) < angle);
                 }
             }
+        };
 
-            // Always just add the last point
-            filtered_lines.back().push_back(line.back());
-        }
-
-        std::swap(lines, filtered_lines);
+        vtkSMPTools::For(0, num_lines, mark_range);
     }
 
-    // Filter lines by size and remove "lines" of one element
-    std::size_t num_indices = 0;
+    // Split lines at marked segments, where the last point of each line is always added to its last part,
+    // and filter lines by size, removing "lines" of one element
+    const vtkIdType min_size = this->SizeFilter ? std::max(1, this->MinSize) : 1;
 
+    auto for_each_part = [&lines, &breaks, min_size](const vtkIdType line_index, const std::function<void(vtkIdType, vtkIdType)>& callback)
     {
-        std::vector<std::vector<vtkIdType>> filtered_lines;
-        filtered_lines.reserve(lines.size());
+        const auto num_points = lines.size(line_index);
+        const auto* line_breaks = breaks.data() + lines.offset(line_index);
+
+        vtkIdType first = -1;
 
-        for (const auto& line : lines)
+        for (vtkIdType p = 0; p < num_points - 1; ++p)
         {
-            if (line.size() > (this->SizeFilter ? std::max(1, this->MinSize) : 1))
+            if (!line_breaks[p] && first == -1)
             {
-                filtered_lines.push_back(line);
-                num_indices += line.size();
+                first = p;
+            }
+            else if (line_breaks[p] && first != -1)
+            {
+                if (p - first > min_size)
+                {
+                    callback(first, p);
+                }
+
+                first = -1;
             }
         }
 
-        std::swap(lines, filtered_lines);
-    }
+        if (num_points > 0 && num_points - (first == -1 ? num_points - 1 : first) > min_size)
+        {
+            callback(first == -1 ? num_points - 1 : first, num_points);
+        }
+    };
 
-    // Create output
-    auto* out_info = output_vector->GetInformationObject(0);
-    auto* output = vtkPolyData::SafeDownCast(out_info->Get(vtkDataObject::DATA_OBJECT()));
+    std::vector<vtkIdType> cell_offsets(num_lines + 1, 0);
 
-    output->SetPoints(input->GetPoints());
+    auto count_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
+        {
+            for_each_part(line_index, [&](vtkIdType, vtkIdType) { ++cell_offsets[line_index + 1]; });
+        }
+    };
 
-    auto cell_indices = vtkSmartPointer<vtkIdTypeArray>::New();
-    cell_indices->SetNumberOfComponents(1);
-    cell_indices->Allocate(lines.size() + num_indices);
+    vtkSMPTools::For(0, num_lines, count_range);
 
-    for (const auto& line : lines)
+    std::partial_sum(cell_offsets.begin(), cell_offsets.end(), cell_offsets.begin());
+
+    line_builder output_lines(cell_offsets[num_lines]);
+
+    auto size_range = [&](const vtkIdType begin, const vtkIdType end)
     {
-        cell_indices->InsertNextValue(line.size());
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
+        {
+            auto cell = cell_offsets[line_index];
 
-        for (const auto& index : line)
+            for_each_part(line_index, [&](const vtkIdType first, const vtkIdType last) { output_lines.set_size(cell++, last - first); });
+        }
+    };
+
+    vtkSMPTools::For(0, num_lines, size_range);
+
+    output_lines.allocate();
+
+    auto write_range = [&](const vtkIdType begin, const vtkIdType end)
+    {
+        for (vtkIdType line_index = begin; line_index < end; ++line_index)
         {
-            cell_indices->InsertNextValue(index);
+            auto cell = cell_offsets[line_index];
+
+            for_each_part(line_index, [&](const vtkIdType first, const vtkIdType last)
+                { std::copy(lines.begin(line_index) + first, lines.begin(line_index) + last, output_lines.begin(cell++)); });
         }
-    }
+    };
+
+    vtkSMPTools::For(0, num_lines, write_range);
 
-    auto cells = vtkSmartPointer<vtkCellArray>::New();
-    cells->SetCells(lines.size(), cell_indices);
+    // Create output
+    auto* out_info = output_vector->GetInformationObject(0);
+    auto* output = vtkPolyData::SafeDownCast(out_info->Get(vtkDataObject::DATA_OBJECT()));
 
-    output->SetLines(cells);
+    output->SetPoints(input->GetPoints());
+    output->SetLines(output_lines.build());
     output->GetPointData()->ShallowCopy(input->GetPointData());
 
     return 1;